@@ -3,6 +3,7 @@
 
 #include <iostream>
 #include <vector>
+#include <map>
 #include <llvm/IR/Value.h>
 #include <llvm/IR/GlobalValue.h>
 #include "../CodeGen/CGContainer.h"
@@ -19,6 +20,8 @@ class NSpecifier;
 class NFunctionDecl;
 class DeclInfo;
 class Declarator;
+class NAttribute;
+class NLoopHint;
 
 typedef std::vector<NStatement*> StatementList;
 typedef std::vector<NExpression*> ExpressionList;
@@ -27,6 +30,8 @@ typedef std::vector<NParamDecl*> ParamList;
 typedef std::vector<NExpression*> ArrayDim;
 typedef std::vector<NSpecifier*> DeclSpecifier;
 typedef std::vector<Declarator *> DeclaratorList;
+typedef std::vector<NAttribute *> AttributeSpecList;
+typedef std::vector<NLoopHint *> LoopHintList;
 
 class Node {
 public:
@@ -45,7 +50,15 @@ class NExpression : public NStatement {
 public:
 	int lineno = -1;
 	char *file_name = NULL;
+	llvm::Type *expr_type = NULL; // memoized result of getExprType
 	virtual ~NExpression() {}
+
+	// type of the rvalue of this expression, computed without emitting IR
+	llvm::Type *getExprType(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
+
+	// as a condition: 1 if it is expected to be true, -1 if false, 0 if unknown
+	virtual int getBranchHint() { return 0; }
 };
 
 class NCompoundExpr : public NExpression {
@@ -65,6 +78,7 @@ public:
 	}
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 
 class NIdentifier : public NExpression {
@@ -82,22 +96,18 @@ public:
 	}
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 
 class DeclInfo {
 public:
 	llvm::Type *type;
-	NIdentifier *id = NULL;
+	NIdentifier *id = NULL; // owned by the declarator
 	NExpression *expr = NULL;
 	ParamList *arguments = NULL;
 
 	DeclInfo(llvm::Type *type, NIdentifier *id) :
 	type(type), id(id) { }
-
-	virtual ~DeclInfo()
-	{
-		delete id;
-	}
 };
 
 // Declarator
@@ -204,6 +214,7 @@ public:
 	virtual ~InitDeclarator()
 	{
 		delete &decl;
+		delete initializer;
 	}
 
 	virtual DeclInfo *getDeclInfo(CodeGenContext& context, llvm::Type *base_type);
@@ -239,7 +250,10 @@ public:
 class SpecifierSet {
 public:
 	llvm::GlobalValue::LinkageTypes linkage = llvm::GlobalValue::CommonLinkage;
+	bool is_inline = false;
+	bool always_inline = false;
 	NType *type = NULL;
+	AttributeSpecList attributes; // owned by the NAttributeSpecifier
 
 	virtual ~SpecifierSet()
 	{
@@ -266,6 +280,17 @@ public:
 	virtual ~NStaticSpecifier() {}
 };
 
+class NInlineSpecifier : public NSpecifier {
+public:
+	bool always; // __always_inline
+
+	NInlineSpecifier(bool always) :
+	always(always) {}
+
+	virtual void setSpecifier(SpecifierSet *dest);
+	virtual ~NInlineSpecifier() {}
+};
+
 class NTypeSpecifier : public NSpecifier {
 public:
 	NType& type;
@@ -281,6 +306,54 @@ public:
 	virtual void setSpecifier(SpecifierSet *dest);
 };
 
+// __attribute__((name)) or __attribute__((name(args...)))
+class NAttribute {
+public:
+	std::string& name;
+	ExpressionList *args;
+
+	NAttribute(std::string& name, ExpressionList *args) :
+	name(name), args(args) { }
+
+	virtual ~NAttribute()
+	{
+		delete &name;
+
+		if (args) {
+			ExpressionList::const_iterator it;
+			for (it = args->begin(); it != args->end(); it++) {
+				delete *it;
+			}
+			delete args;
+		}
+	}
+
+	// "packed" also matches "__packed__"
+	bool is(const std::string& attr_name)
+	{
+		return name == attr_name || name == "__" + attr_name + "__";
+	}
+};
+
+class NAttributeSpecifier : public NSpecifier {
+public:
+	AttributeSpecList& attributes;
+
+	NAttributeSpecifier(AttributeSpecList& attributes) :
+	attributes(attributes) { }
+
+	virtual ~NAttributeSpecifier()
+	{
+		AttributeSpecList::const_iterator it;
+		for (it = attributes.begin(); it != attributes.end(); it++) {
+			delete *it;
+		}
+		delete &attributes;
+	}
+
+	virtual void setSpecifier(SpecifierSet *dest);
+};
+
 class NIdentifierType : public NType {
 public:
 	int lineno = -1;
@@ -325,6 +398,7 @@ public:
 	}
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 class NChar : public NExpression {
 public:
@@ -339,6 +413,7 @@ public:
 	{ }
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 class NBoolean : public NExpression {
 public:
@@ -352,6 +427,7 @@ public:
 	virtual ~NBoolean() {}
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 class NDouble : public NExpression {
 public:
@@ -365,6 +441,7 @@ public:
 	virtual ~NDouble() {}
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 class NString : public NExpression {
 public:
@@ -378,6 +455,7 @@ public:
 	virtual ~NString() {}
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 // Primary Expression End
 
@@ -407,6 +485,7 @@ public:
 	}
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 class NFieldExpr : public NExpression {
 public:
@@ -425,6 +504,7 @@ public:
 	}
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 class NArrayExpr : public NExpression {
 public:
@@ -443,6 +523,7 @@ public:
 	}
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 class NCondExpr : public NExpression {
 public:
@@ -463,9 +544,7 @@ public:
 	}
 
 	virtual CGValue codeGen(CodeGenContext& context);
-	virtual void castCompare(CodeGenContext& context,
-							  llvm::BasicBlock *lhs_true, llvm::Value *&lhs,
-							  llvm::BasicBlock *lhs_else, llvm::Value *&rhs);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 // Postfix Expression End
 
@@ -493,6 +572,7 @@ public:
 	}
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 
 // Prefix Expression
@@ -521,6 +601,50 @@ public:
 	}
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
+	virtual int getBranchHint();
+};
+
+// &&label, the address of a label in the current function
+class NLabelAddressExpr : public NExpression {
+public:
+	int lineno = -1;
+	char *file_name = NULL;
+	std::string label_name;
+
+	NLabelAddressExpr(std::string label_name) :
+	label_name(label_name) { }
+
+	virtual ~NLabelAddressExpr() {}
+
+	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
+};
+
+// likely(x), unlikely(x) and __builtin_expect(x, expected)
+class NExpectExpr : public NExpression {
+public:
+	int lineno = -1;
+	char *file_name = NULL;
+	NExpression& operand;
+	NExpression *expected; // NULL for likely and unlikely
+	int hint;
+
+	NExpectExpr(NExpression& operand, bool likely) :
+	operand(operand), expected(NULL), hint(likely ? 1 : -1) { }
+
+	NExpectExpr(NExpression& operand, NExpression& expected) :
+	operand(operand), expected(&expected), hint(0) { }
+
+	virtual ~NExpectExpr()
+	{
+		delete &operand;
+		delete expected;
+	}
+
+	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
+	virtual int getBranchHint() { return hint; }
 };
 
 class NIncDecExpr : public NExpression {
@@ -539,6 +663,7 @@ public:
 	}
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 
 class NAssignmentExpr : public NExpression {
@@ -553,6 +678,8 @@ public:
 
 	static llvm::Value *doAssignCast(CodeGenContext& context, llvm::Value *value,
 									  llvm::Type *variable_type, llvm::Value *variable, int lineno, char *file_name);
+	static llvm::Value *emitStore(CodeGenContext& context, llvm::Value *ptr, NExpression& rval,
+								  int lineno, char *file_name);
 
 	virtual ~NAssignmentExpr()
 	{
@@ -561,6 +688,7 @@ public:
 	}
 
 	virtual CGValue codeGen(CodeGenContext& context);
+	virtual llvm::Type *resolveType(CodeGenContext& context);
 };
 
 class NTypeof : public NType {
@@ -585,9 +713,10 @@ public:
 	int lineno = -1;
 	char *file_name = NULL;
 	NExpression& expression;
+	bool must_tail; // return tail f(...)
 
-	NReturnStatement(NExpression& expression) :
-	expression(expression) { }
+	NReturnStatement(NExpression& expression, bool must_tail = false) :
+	expression(expression), must_tail(must_tail) { }
 
 	virtual ~NReturnStatement()
 	{
@@ -618,12 +747,64 @@ public:
 	virtual CGValue codeGen(CodeGenContext& context);
 };
 
+class NSwitchStatement : public NStatement {
+public:
+	int lineno = -1;
+	char *file_name = NULL;
+	NExpression& condition;
+	NStatement *body;
+
+	NSwitchStatement(NExpression& condition, NStatement *body) :
+	condition(condition), body(body) { }
+
+	virtual ~NSwitchStatement()
+	{
+		delete &condition;
+		delete body;
+	}
+
+	virtual CGValue codeGen(CodeGenContext& context);
+};
+
+// one hint of #pragma loop, e.g. unroll(8) or vectorize(width=4)
+class NLoopHint {
+public:
+	int lineno = -1;
+	char *file_name = NULL;
+	std::string& name;
+	NExpression& arg;
+
+	NLoopHint(std::string& name, NExpression& arg) :
+	name(name), arg(arg) { }
+
+	virtual ~NLoopHint()
+	{
+		delete &name;
+		delete &arg;
+	}
+};
+
+inline void
+deleteLoopHints(LoopHintList *loop_hints)
+{
+	LoopHintList::const_iterator it;
+
+	if (loop_hints) {
+		for (it = loop_hints->begin(); it != loop_hints->end(); it++) {
+			delete *it;
+		}
+		delete loop_hints;
+	}
+	return;
+}
+
 class NWhileStatement : public NStatement {
 public:
 	int lineno = -1;
 	char *file_name = NULL;
 	NExpression &condition;
 	NStatement *while_true;
+	LoopHintList *loop_hints = NULL;
 
 	NWhileStatement(NExpression &condition, NStatement *while_true) :
 	condition(condition), while_true(while_true) { }
@@ -632,6 +813,7 @@ public:
 	{
 		delete &condition;
 		delete while_true;
+		deleteLoopHints(loop_hints);
 	}
 
 	virtual CGValue codeGen(CodeGenContext& context);
@@ -645,6 +827,7 @@ public:
 	NExpression &condition;
 	NExpression &tail;
 	NStatement *for_true;
+	LoopHintList *loop_hints = NULL;
 
 	NForStatement(NExpression &initializer, NExpression& condition, NExpression &tail, NStatement *for_true) :
 	initializer(initializer), condition(condition), tail(tail), for_true(for_true) { }
@@ -655,6 +838,7 @@ public:
 		delete &condition;
 		delete &tail;
 		delete for_true;
+		deleteLoopHints(loop_hints);
 	}
 
 	virtual CGValue codeGen(CodeGenContext& context);
@@ -697,16 +881,44 @@ public:
 	virtual CGValue codeGen(CodeGenContext& context);
 };
 
+// case value: statement, or default: statement without a value
+class NCaseStatement : public NStatement {
+public:
+	int lineno = -1;
+	char *file_name = NULL;
+	NExpression *value;
+	NStatement& statement;
+
+	NCaseStatement(NExpression *value, NStatement& statement) :
+	value(value), statement(statement) { }
+
+	virtual ~NCaseStatement()
+	{
+		delete value;
+		delete &statement;
+	}
+
+	virtual CGValue codeGen(CodeGenContext& context);
+};
+
 class NGotoStatement : public NStatement {
 public:
 	int lineno = -1;
 	char *file_name = NULL;
 	std::string label_name;
+	NExpression *target; // goto *target, NULL for a direct goto
 
 	NGotoStatement(std::string label_name) :
-	label_name(label_name) { }
+	label_name(label_name), target(NULL) { }
+
+	NGotoStatement(NExpression& target) :
+	target(&target) { }
+
+	virtual ~NGotoStatement()
+	{
+		delete target;
+	}
 
-	virtual ~NGotoStatement() {}
 	virtual CGValue codeGen(CodeGenContext& context);
 };
 
@@ -782,6 +994,7 @@ public:
 	char *file_name = NULL;
 	NIdentifier& id;
     VariableList *fields;
+	AttributeSpecList *attributes = NULL;
 
     NStructDecl(NIdentifier& id, VariableList *fields) :
 	id(id), fields(fields) { }
@@ -790,6 +1003,14 @@ public:
 	{
 		delete &id;
 
+		if (attributes) {
+			AttributeSpecList::const_iterator it;
+			for (it = attributes->begin(); it != attributes->end(); it++) {
+				delete *it;
+			}
+			delete attributes;
+		}
+
 		if (fields) {
 			VariableList::const_iterator it;
 			for (it = fields->begin(); it != fields->end(); it++) {
@@ -808,6 +1029,7 @@ public:
 	char *file_name = NULL;
 	NIdentifier& id;
 	VariableList *fields;
+	AttributeSpecList *attributes = NULL;
 
     NUnionDecl(NIdentifier& id, VariableList *fields) :
 	id(id), fields(fields) { }
@@ -816,6 +1038,14 @@ public:
 	{
 		delete &id;
 
+		if (attributes) {
+			AttributeSpecList::const_iterator it;
+			for (it = attributes->begin(); it != attributes->end(); it++) {
+				delete *it;
+			}
+			delete attributes;
+		}
+
 		if (fields) {
 			VariableList::const_iterator it;
 			for (it = fields->begin(); it != fields->end(); it++) {
@@ -922,6 +1152,13 @@ public:
 	Declarator& decl;
 	NBlock *block;
 
+	// unparsed body of a static function, see -flazy-parse
+	std::string *lazy_body = NULL;
+	int lazy_lineno = -1;
+	std::map<std::string, int> *lazy_type_def = NULL; // typedef names visible at the body
+	std::string lazy_namespace;
+	bool moved_from = false;
+
 	// specifiers: will be set by specifier
 	SpecifierSet *specifiers;
 
@@ -931,6 +1168,11 @@ public:
 
 	virtual ~NFunctionDecl()
 	{
+		delete specifiers;
+		if (moved_from) { // members are owned by the node returned by moveLazyBody
+			return;
+		}
+
 		delete &decl;
 
 		DeclSpecifier::iterator di;
@@ -941,9 +1183,12 @@ public:
 		delete &func_specifier;
 
 		delete block;
-		delete specifiers;
+		delete lazy_body;
+		delete lazy_type_def;
 	}
 
+	NFunctionDecl *moveLazyBody();
+
 	virtual CGValue codeGen(CodeGenContext& context);
 };
 
@@ -2,9 +2,14 @@
 #define _PARSER_H_
 
 #include "Node.h"
+#include "../CodeGen/CGStats.h"
 #include <stdio.h>
 #include <string.h>
 #include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 class CodeGenContext;
 class Parser;
 
@@ -12,11 +17,60 @@ extern Parser *main_parser;
 extern FILE *yyin;
 extern int yyparse();
 extern int yylex_destroy();
+struct yy_buffer_state;
+extern yy_buffer_state *yy_scan_string(const char *str);
+extern void yy_delete_buffer(yy_buffer_state *buffer);
+
+#define STREAM_QUEUE_LIMIT 16
 
 class Parser {
 	NBlock *syntax_tree = NULL;
 	vector<NStatement *> *extern_decls;
 
+	// streaming mode: top-level statements are generated and freed right after they are parsed
+	CodeGenContext *stream_context = NULL;
+	bool stream_thread = false;
+	std::thread *codegen_thread = NULL;
+	std::mutex queue_mutex;
+	std::condition_variable queue_cond;
+	std::deque<NStatement *> stream_queue;
+	bool parse_finished = false;
+
+	bool lazy_parse = false;
+	NStatement **capture_slot = NULL;
+
+	void generateStatement(NStatement *stmt)
+	{
+		if (stmt) {
+			stmt->codeGen(*stream_context);
+			delete stmt;
+		}
+
+		return;
+	}
+
+	void runCodeGenThread()
+	{
+		NStatement *stmt;
+
+		while (true) {
+			{
+				std::unique_lock<std::mutex> lock(queue_mutex);
+				queue_cond.wait(lock, [this] { return parse_finished || !stream_queue.empty(); });
+				if (stream_queue.empty()) {
+					break;
+				}
+				stmt = stream_queue.front();
+				stream_queue.pop_front();
+			}
+			queue_cond.notify_all();
+
+			generateStatement(stmt);
+		}
+
+		return;
+	}
+
 public:
 	NBlock* getAST()
 	{
@@ -41,6 +95,89 @@ public:
 		return;
 	}
 
+	void setStreaming(CodeGenContext *context, bool use_thread)
+	{
+		stream_context = context;
+		stream_thread = use_thread;
+		return;
+	}
+
+	// called by the grammar for each completed top-level declaration
+	void addStatement(NStatement *stmt)
+	{
+		compiler_stats.clearCountedNodes();
+
+		if (capture_slot) {
+			*capture_slot = stmt;
+		} else if (!stream_context) {
+			syntax_tree->statements.push_back(stmt);
+		} else if (!stream_thread) {
+			generateStatement(stmt);
+		} else {
+			{
+				// bound the queue so the parser cannot run arbitrarily far ahead
+				std::unique_lock<std::mutex> lock(queue_mutex);
+				queue_cond.wait(lock, [this] { return stream_queue.size() < STREAM_QUEUE_LIMIT; });
+				stream_queue.push_back(stmt);
+			}
+			queue_cond.notify_all();
+		}
+
+		return;
+	}
+
+	void setLazyParse(bool enable)
+	{
+		lazy_parse = enable;
+		return;
+	}
+
+	bool isLazyParse()
+	{
+		return lazy_parse;
+	}
+
+	// parse a function body skipped by the scanner; only valid once the main parse is over
+	NBlock *parseLazyBody(std::string& body, int lineno, char *file,
+						  std::map<std::string, int> *body_type_def)
+	{
+		extern int current_line_number;
+		extern char *current_file;
+		extern std::map<std::string, int> type_def;
+		std::map<std::string, int> saved_type_def;
+		std::string text = "void __lazy_body() " + body;
+		NStatement *wrapper = NULL;
+		yy_buffer_state *buffer;
+		bool saved_lazy_parse = lazy_parse;
+		NBlock *ret;
+
+		lazy_parse = false;
+		capture_slot = &wrapper;
+		current_line_number = lineno;
+		current_file = file;
+		if (body_type_def) {
+			saved_type_def.swap(type_def);
+			type_def = *body_type_def;
+		}
+
+		buffer = yy_scan_string(text.c_str());
+		yyparse();
+		yy_delete_buffer(buffer);
+		yylex_destroy();
+
+		if (body_type_def) {
+			type_def.swap(saved_type_def);
+		}
+		capture_slot = NULL;
+		lazy_parse = saved_lazy_parse;
+
+		ret = ((NFunctionDecl *)wrapper)->block;
+		((NFunctionDecl *)wrapper)->block = NULL;
+		delete wrapper;
+
+		return ret;
+	}
+
 	void addDecl(NStatement *func)
 	{
 		extern_decls->push_back(func);
@@ -51,10 +188,26 @@ public:
 	{
 		main_parser = this;
 		yyin = fp;
+
+		if (stream_context && stream_thread) {
+			codegen_thread = new std::thread(&Parser::runCodeGenThread, this);
+		}
+
 		yyparse();
 		yylex_destroy();
 		fclose(fp);
 
+		if (codegen_thread) {
+			{
+				std::lock_guard<std::mutex> lock(queue_mutex);
+				parse_finished = true;
+			}
+			queue_cond.notify_all();
+			codegen_thread->join();
+			delete codegen_thread;
+			codegen_thread = NULL;
+		}
+
 		return;
 	}
 
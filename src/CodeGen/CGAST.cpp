@@ -1,8 +1,13 @@
 #include "AST/Node.h"
+#include "AST/Parser.h"
 #include "CGAST.h"
 #include "CGErr.h"
 #include "Grammar/Parser.hpp"
 #include "Inlines.h"
+#include <algorithm>
+#include <llvm/Analysis/Passes.h>
+#include <llvm/Target/TargetLibraryInfo.h>
+#include <llvm/Transforms/IPO.h>
 
 using namespace std;
 #define MAIN_FUNCTOIN_NAME ("main")
@@ -11,8 +16,120 @@ void
 CodeGenContext::generateCode(NBlock& AST)
 {
 	AST.codeGen(*this);
+	generateLazyBodies();
 	terminateGlobalConstructor();
 	appendToGlobalCtors(*module, global_constructor, 65535);
+	finalizeProfile();
+	finalizeDebugInfo();
+	finalizeLinkage();
+	inferFunctionAttributes();
+	return;
+}
+
+// musttail needs the caller and the callee on the same calling convention
+static bool
+hasMustTailCall(Function *function)
+{
+	Function::iterator block_it;
+	BasicBlock::iterator inst_it;
+	Value::use_iterator use_it;
+	CallInst *call;
+
+	for (use_it = function->use_begin(); use_it != function->use_end(); use_it++) {
+		if ((call = dyn_cast<CallInst>(use_it->getUser())) && call->isMustTailCall()) {
+			return true;
+		}
+	}
+
+	for (block_it = function->begin(); block_it != function->end(); block_it++) {
+		for (inst_it = block_it->begin(); inst_it != block_it->end(); inst_it++) {
+			if ((call = dyn_cast<CallInst>(inst_it)) && call->isMustTailCall()) {
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+// &&label keeps a blockaddress of the function, which hasAddressTaken() does not count
+static bool
+hasBlockAddress(Function *function)
+{
+	Value::use_iterator use_it;
+
+	for (use_it = function->use_begin(); use_it != function->use_end(); use_it++) {
+		if (isa<BlockAddress>(use_it->getUser())) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// local functions whose address never escapes are only called from here, so they
+// can use fastcc; local values whose address is not compared get unnamed_addr
+void
+CodeGenContext::finalizeLinkage()
+{
+	Module::iterator func_it;
+	Module::global_iterator var_it;
+	Value::use_iterator use_it;
+	CallSite call_site;
+
+	for (func_it = module->begin(); func_it != module->end(); func_it++) {
+		if (!func_it->hasLocalLinkage() || func_it->isDeclaration() || func_it->hasAddressTaken()) {
+			continue;
+		}
+
+		func_it->setUnnamedAddr(true);
+		if (func_it->isVarArg() // fastcc has no va_list of its own
+			|| hasMustTailCall(&*func_it)
+			|| hasBlockAddress(&*func_it)) {
+			continue;
+		}
+		func_it->setCallingConv(CallingConv::Fast);
+		for (use_it = func_it->use_begin(); use_it != func_it->use_end(); use_it++) {
+			call_site = CallSite(use_it->getUser());
+			if (!call_site || !call_site.isCallee(&*use_it)) { // not a call of the function
+				continue;
+			}
+			call_site.setCallingConv(CallingConv::Fast);
+		}
+	}
+
+	for (var_it = module->global_begin(); var_it != module->global_end(); var_it++) {
+		if (!var_it->hasLocalLinkage() || var_it->hasUnnamedAddr()) {
+			continue;
+		}
+
+		for (use_it = var_it->use_begin(); use_it != var_it->use_end(); use_it++) {
+			if (!isa<LoadInst>(use_it->getUser())
+				&& !(isa<StoreInst>(use_it->getUser()) && use_it->getOperandNo() == 1)) {
+				break;
+			}
+		}
+		if (use_it == var_it->use_end()) {
+			var_it->setUnnamedAddr(true);
+		}
+	}
+
+	return;
+}
+
+// readnone, readonly and noreturn, inferred bottom-up over the call graph
+// so calls to the functions can be CSE'd and hoisted out of loops
+void
+CodeGenContext::inferFunctionAttributes()
+{
+	PassManager pm;
+
+	pm.add(new TargetLibraryInfo(Triple(module->getTargetTriple())));
+	pm.add(createBasicAliasAnalysisPass()); // loads and stores of locals do not count
+	pm.add(createPruneEHPass()); // noreturn
+	pm.add(createFunctionAttrsPass()); // readnone, readonly, nocapture and noalias returns
+	pm.run(*module);
+
 	return;
 }
 
@@ -78,6 +195,22 @@ CodeGenContext::getRandomString(int length)
 	return ret_str;
 }
 
+void
+CodeGenContext::setArithmeticMode(const ArithmeticMode& mode)
+{
+	FastMathFlags fmf;
+
+	arith = mode;
+	if (mode.fast_math) {
+		fmf.setUnsafeAlgebra();
+		builder->SetFastMathFlags(fmf);
+	} else {
+		builder->clearFastMathFlags();
+	}
+
+	return;
+}
+
 void
 CodeGenContext::setGlobalConstructor()
 {
@@ -97,9 +230,17 @@ CodeGenContext::setGlobalConstructor()
 void
 CodeGenContext::terminateGlobalConstructor()
 {
+	Function::const_iterator block_it;
+
 	setGlobalConstructor();
 	builder->CreateRetVoid();
 	popAllBlock();
+
+	for (block_it = global_constructor->begin();
+		 block_it != global_constructor->end(); block_it++) {
+		compiler_stats.global_ctor_insts += block_it->size();
+	}
+
 	return;
 }
 
@@ -133,6 +274,108 @@ CodeGenContext::getGlobals()
     return globals;
 }
 
+void
+CodeGenContext::addLazyDecl(const std::string& name, Type *type, GlobalValue::LinkageTypes linkage,
+							AttributeSet attributes)
+{
+	LazyDecl lazy_decl;
+
+	lazy_decl.type = type;
+	lazy_decl.linkage = linkage;
+	lazy_decl.attributes = attributes;
+	lazy_decls[name] = lazy_decl;
+	STATS_INC(lazy_decls);
+
+	return;
+}
+
+Value *
+CodeGenContext::materializeLazyDecl(const std::string& name)
+{
+	std::map<std::string, LazyDecl>::iterator lazy_it;
+	Value *ret;
+
+	if (lazy_decls.empty()
+		|| (lazy_it = lazy_decls.find(name)) == lazy_decls.end()) {
+		return NULL;
+	}
+
+	if (isa<FunctionType>(lazy_it->second.type)) {
+		ret = Function::Create(dyn_cast<FunctionType>(lazy_it->second.type),
+							   lazy_it->second.linkage, name, module);
+		dyn_cast<Function>(ret)->setAttributes(lazy_it->second.attributes);
+	} else {
+		ret = new GlobalVariable(*module, lazy_it->second.type, false,
+								 lazy_it->second.linkage, NULL, name);
+		getGlobals()[name] = ret;
+	}
+	lazy_decls.erase(lazy_it);
+	STATS_INC(lazy_materialized);
+
+	return ret;
+}
+
+void
+CodeGenContext::removeLazyDecl(const std::string& name)
+{
+	lazy_decls.erase(name);
+	return;
+}
+
+void
+CodeGenContext::addLazyBody(Function *function, NFunctionDecl *func_decl)
+{
+	delete lazy_bodies[function];
+	func_decl->lazy_namespace = current_namespace;
+	lazy_bodies[function] = func_decl;
+	STATS_INC(lazy_bodies);
+
+	return;
+}
+
+void
+CodeGenContext::generateLazyBodies()
+{
+	std::map<Function *, NFunctionDecl *>::iterator lazy_it;
+	NFunctionDecl *func_decl;
+	std::string saved_namespace = current_namespace;
+	bool changed = true;
+
+	// a body is needed once its function is referenced; generating it
+	// may in turn reach other static functions
+	while (changed) {
+		changed = false;
+		for (lazy_it = lazy_bodies.begin(); lazy_it != lazy_bodies.end();) {
+			if (lazy_it->first->use_empty()) {
+				lazy_it++;
+				continue;
+			}
+
+			func_decl = lazy_it->second;
+			lazy_bodies.erase(lazy_it++);
+
+			// parsed and generated in the scope the function was declared in
+			current_namespace = func_decl->lazy_namespace;
+			func_decl->block = main_parser->parseLazyBody(*func_decl->lazy_body, func_decl->lazy_lineno,
+														  ((NStatement *)func_decl)->file_name,
+														  func_decl->lazy_type_def);
+			func_decl->codeGen(*this);
+			current_namespace = saved_namespace;
+			delete func_decl;
+			STATS_INC(lazy_bodies_parsed);
+			changed = true;
+		}
+	}
+
+	for (lazy_it = lazy_bodies.begin(); lazy_it != lazy_bodies.end(); lazy_it++) {
+		lazy_it->first->eraseFromParent();
+		delete lazy_it->second;
+	}
+	lazy_bodies.clear();
+
+	return;
+}
+
 BasicBlock *
 CodeGenContext::getLabel(std::string name)
 {
@@ -142,9 +385,100 @@ CodeGenContext::getLabel(std::string name)
 	return labels[name];
 }
 
+Value *
+CodeGenContext::getLabelAddress(BasicBlock *block)
+{
+	if (std::find(label_addresses.begin(), label_addresses.end(), block) == label_addresses.end()) {
+		label_addresses.push_back(block);
+	}
+
+	return BlockAddress::get(block->getParent(), block);
+}
+
+void
+CodeGenContext::addIndirectGoto(IndirectBrInst *br)
+{
+	indirect_gotos.push_back(br);
+	return;
+}
+
+// at the end of a function: every goto *expr may reach every label whose address
+// was taken, each keeps its own indirectbr so dispatch stays threaded
+void
+CodeGenContext::resolveIndirectGotos()
+{
+	std::vector<IndirectBrInst *>::const_iterator br_it;
+	std::vector<BasicBlock *>::const_iterator block_it;
+
+	for (br_it = indirect_gotos.begin(); br_it != indirect_gotos.end(); br_it++) {
+		for (block_it = label_addresses.begin(); block_it != label_addresses.end(); block_it++) {
+			(*br_it)->addDestination(*block_it);
+		}
+	}
+
+	labels.clear();
+	label_addresses.clear();
+	indirect_gotos.clear();
+
+	return;
+}
+
+void
+CodeGenContext::addTailCall(CallInst *call)
+{
+	tail_calls.push_back(call);
+	return;
+}
+
+// a callee may only reuse the frame if no local of the caller can be reached
+// through a pointer, that is every alloca is only loaded and stored to
+static bool
+hasEscapedLocal(Function *function)
+{
+	Function::iterator block_it;
+	BasicBlock::iterator inst_it;
+	Value::use_iterator use_it;
+
+	for (block_it = function->begin(); block_it != function->end(); block_it++) {
+		for (inst_it = block_it->begin(); inst_it != block_it->end(); inst_it++) {
+			if (!isa<AllocaInst>(inst_it)) {
+				continue;
+			}
+			for (use_it = inst_it->use_begin(); use_it != inst_it->use_end(); use_it++) {
+				if (!isa<LoadInst>(use_it->getUser())
+					&& !(isa<StoreInst>(use_it->getUser()) && use_it->getOperandNo() == 1)) {
+					return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+// at the end of a function, once every use of its locals is known
+void
+CodeGenContext::markTailCalls(Function *function)
+{
+	std::vector<CallInst *>::const_iterator call_it;
+
+	if (!hasEscapedLocal(function)) {
+		for (call_it = tail_calls.begin(); call_it != tail_calls.end(); call_it++) {
+			if (!(*call_it)->isMustTailCall()) {
+				(*call_it)->setTailCall();
+			}
+		}
+	}
+	tail_calls.clear();
+
+	return;
+}
+
 FieldMap *
 CodeGenContext::getStruct(std::string name)
 {
+	STATS_INC(struct_lookups);
+
 	if (currentBlock()
 		&& blocks.top()->structs.find(formatName(name)) != blocks.top()->structs.end()) {
 		return &blocks.top()->structs[formatName(name)];
@@ -163,6 +497,7 @@ CodeGenContext::getStruct(std::string name)
 		return &structs[name];
 	}
 
+	STATS_INC(struct_misses);
 	return NULL;
 }
 
@@ -181,6 +516,8 @@ CodeGenContext::setStruct(std::string name, FieldMap map)
 UnionFieldMap *
 CodeGenContext::getUnion(std::string name)
 {
+	STATS_INC(union_lookups);
+
 	if (currentBlock()
 		&& blocks.top()->unions.find(formatName(name)) != blocks.top()->unions.end()) {
 		return &blocks.top()->unions[formatName(name)];
@@ -199,6 +536,7 @@ CodeGenContext::getUnion(std::string name)
 		return &unions[name];
 	}
 
+	STATS_INC(union_misses);
 	return NULL;
 }
 
@@ -214,9 +552,59 @@ CodeGenContext::setUnion(std::string name, UnionFieldMap map)
 	return;
 }
 
+// NULL if type is incomplete, the descriptor is only cached once it has a body
+const RecordLayout *
+CodeGenContext::getLayout(StructType *type)
+{
+	std::unordered_map<StructType *, RecordLayout>::const_iterator layout_it;
+	FieldMap *field_map;
+	UnionFieldMap *union_map;
+	FieldMap::const_iterator field_it;
+	UnionFieldMap::const_iterator ufield_it;
+	RecordLayout *layout;
+	FieldLayout field;
+
+	if ((layout_it = layouts.find(type)) != layouts.end()) {
+		return &layout_it->second;
+	}
+
+	if (type->isLiteral()) {
+		return NULL;
+	}
+
+	if (!type->getName().startswith(UNION_PREFIX)) {
+		if (!(field_map = getStruct(type->getName().str()))) {
+			return NULL;
+		}
+
+		layout = &layouts[type];
+		for (field_it = field_map->begin(); field_it != field_map->end(); field_it++) {
+			field.index = field_it->second;
+			field.type = type->getElementType(field_it->second);
+			layout->fields[field_it->first] = field;
+		}
+	} else {
+		if (!(union_map = getUnion(type->getName().str()))) {
+			return NULL;
+		}
+
+		layout = &layouts[type];
+		layout->is_union = true;
+		for (ufield_it = union_map->begin(); ufield_it != union_map->end(); ufield_it++) {
+			field.index = 0;
+			field.type = ufield_it->second;
+			layout->fields[ufield_it->first] = field;
+		}
+	}
+
+	return layout;
+}
+
 Type *
 CodeGenContext::getType(std::string name)
 {
+	STATS_INC(type_lookups);
+
 	if (currentBlock()
 		&& blocks.top()->local_types.find(formatName(name)) != blocks.top()->local_types.end()) {
 		return blocks.top()->local_types[formatName(name)];
@@ -235,6 +623,7 @@ CodeGenContext::getType(std::string name)
 		return types[name];
 	}
 
+	STATS_INC(type_misses);
 	return NULL;
 }
 
@@ -328,6 +717,8 @@ CodeGenContext::pushBlock(BasicBlock *block)
 {
 	CodeGenBlock *newb = new CodeGenBlock();
 
+	STATS_INC(scope_pushes);
+
     newb->returnValue = NULL;
     newb->block = block;
 	if (currentBlock()) { // inherit locals
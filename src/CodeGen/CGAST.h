@@ -2,6 +2,8 @@
 #define _GENCODE_H_
 
 #include <stack>
+#include <set>
+#include <unordered_map>
 #include <typeinfo>
 #include <assert.h>
 #include <llvm/IR/Module.h>
@@ -14,6 +16,7 @@
 #include <llvm/IR/CallingConv.h>
 #include <llvm/IR/IRPrintingPasses.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/DIBuilder.h>
 #include <llvm/IR/CallSite.h>
 #include <llvm/Bitcode/ReaderWriter.h>
 #include <llvm/Support/TargetSelect.h>
@@ -24,21 +27,42 @@
 #include <llvm/Transforms/Utils/ModuleUtils.h>
 #include "../ErrorMsg/EMCore.h"
 #include "CGContainer.h"
+#include "CGStats.h"
 #include <time.h>
 
 #define STRUCT_PREFIX ("struct.")
 #define UNION_PREFIX ("union.")
 #define ANON_POSTFIX ("anon")
+#define PROFILER_ENTER_NAME ("__phi_func_enter") // see Lib/runtime/phiprof.c
+#define PROFILER_EXIT_NAME ("__phi_func_exit")
 
 using namespace llvm;
 
 class NBlock;
+class NFunctionDecl;
+class NAttribute;
 class CodeGenContext;
 
+// arithmetic a function may assume, set by options and __attribute__((optimize(...)))
+class ArithmeticMode {
+public:
+	bool wrapv = false; // signed overflow wraps, so no nsw
+	bool fast_math = false;
+	bool fp_contract = false; // fuse multiply-add
+};
+
 typedef std::map<std::string, Type*> TypeInfoTable;
 TypeInfoTable initializeBasicType(CodeGenContext& context);
 CGValue codeGenLoadValue(CodeGenContext& context, Value *V);
 uint64_t getConstantIntExprJIT(Constant *const_expr);
+NAttribute *findAttribute(std::vector<NAttribute *> *attributes, const char *name);
+unsigned getAlignAttribute(CodeGenContext& context, std::vector<NAttribute *> *attributes,
+						   int lineno, char *file_name);
+ArithmeticMode getArithmeticMode(CodeGenContext& context, std::vector<NAttribute *> *attributes,
+								 int lineno, char *file_name);
+AttributeSet getFunctionAttributes(std::vector<NAttribute *> *attributes, Type *ret_type);
+void setVisibility(CodeGenContext& context, GlobalValue *value, std::vector<NAttribute *> *attributes,
+				   int lineno, char *file_name);
 
 typedef std::map<std::string, int> FieldMap;
 typedef std::map<std::string, Type *> UnionFieldMap;
@@ -50,6 +74,69 @@ typedef struct {
 	std::map<std::string, UnionFieldMap> unions;
 } BlockLocalContext;
 
+// extern prototype or global that has not been emitted into the module yet
+class LazyDecl {
+public:
+	Type *type;
+	GlobalValue::LinkageTypes linkage;
+	AttributeSet attributes; // of a function
+};
+
+// resolved field of a struct or union
+class FieldLayout {
+public:
+	unsigned index; // element index, unused for unions
+	Type *type;
+};
+
+// field table of a complete struct/union type, built once per StructType
+class RecordLayout {
+public:
+	bool is_union = false;
+	std::unordered_map<std::string, FieldLayout> fields;
+
+	inline const FieldLayout *
+	getField(const std::string& name) const
+	{
+		std::unordered_map<std::string, FieldLayout>::const_iterator field_it = fields.find(name);
+		return field_it != fields.end() ? &field_it->second : NULL;
+	}
+};
+
+// transformations requested by a #pragma loop, indexed by the id tagged into its llvm.loop node
+class LoopPragma {
+public:
+	int lineno;
+	char *file_name;
+	bool unroll = false;
+	bool vectorize = false;
+	bool interleave = false;
+};
+
+// counters of one function read from a -fprofile-use profile
+class FunctionProfile {
+public:
+	std::vector<uint64_t> counts;
+	std::map<unsigned, std::string> targets; // callee name of each indirect call slot
+};
+
+// counters of one function instrumented by -fprofile-generate
+class ProfiledFunction {
+public:
+	std::string name;
+	unsigned first; // into the counter array
+	unsigned size;
+	std::set<unsigned> target_slots;
+};
+
+#define PROFILE_NO_SLOT ((unsigned)-1)
+
+class SourceLocation {
+public:
+	int lineno;
+	char *file_name;
+};
+
 class CodeGenBlock {
 public:
     BasicBlock *block;
@@ -64,7 +151,13 @@ public:
 class CodeGenContext {
     std::stack<CodeGenBlock *> blocks;
 	std::map<std::string, Value*> globals;
-	std::map<std::string, BasicBlock*> labels;
+	std::map<std::string, BasicBlock*> labels; // of the current function
+	std::vector<BasicBlock *> label_addresses; // labels whose address was taken
+	std::vector<IndirectBrInst *> indirect_gotos;
+	std::vector<CallInst *> tail_calls; // return f(...) of the current function
+	std::map<std::string, LazyDecl> lazy_decls;
+	std::map<Function *, NFunctionDecl *> lazy_bodies;
+	std::unordered_map<StructType *, RecordLayout> layouts;
 	bool is_lvalue;
 
 public:
@@ -80,10 +173,41 @@ public:
 	BasicBlock *current_end_block; // used for branch
 	BasicBlock *current_break_block;
 	BasicBlock *current_continue_block;
+	SwitchInst *current_switch = NULL; // the cases below add to it
+	bool must_tail = false; // the call being emitted is return tail f(...)
+	bool current_switch_has_default = false;
 	std::string current_namespace;
 	Function *global_constructor;
 
 	int in_param_flag = 0;
+	std::vector<LoopPragma> loop_pragmas;
+	std::map<std::string, SourceLocation> function_locations; // where each emitted function is defined
+
+	// line tables for -g, see CGDebug.cpp
+	DIBuilder *debug_builder = NULL;
+	MDNode *debug_unit = NULL;
+	MDNode *debug_subprogram = NULL;
+	std::map<std::string, MDNode *> debug_files;
+	std::map<std::string, MDNode *> debug_scopes; // of the current function, by file
+
+	// -fprofile-generate and -fprofile-use, see CGProfile.cpp
+	std::string profile_output; // set when instrumenting
+	std::string profile_unit; // source file, qualifies the names of local functions
+	std::map<std::string, FunctionProfile> profile_data;
+	uint64_t profile_max_entry = 0;
+	GlobalVariable *profile_counters = NULL; // placeholder until the counter array is sized
+	std::vector<ProfiledFunction> profiled_functions;
+	FunctionProfile *current_profile = NULL;
+	unsigned profile_slot = 0; // next counter of the current function
+	bool profiling = false;
+
+	bool instrument_functions = false; // -finstrument-functions
+
+	bool common_globals = false; // -fcommon, tentative definitions are merged by the linker
+	GlobalValue::VisibilityTypes default_visibility = GlobalValue::DefaultVisibility; // -fvisibility=
+
+	ArithmeticMode default_arith; // from the command line
+	ArithmeticMode arith; // of the function being emitted
 
     CodeGenContext() {
         module = new Module("main", getGlobalContext());
@@ -120,7 +244,53 @@ public:
 
     std::map<std::string, Value*>& getGlobals();
 
+	void addLazyDecl(const std::string& name, Type *type, GlobalValue::LinkageTypes linkage,
+					 AttributeSet attributes = AttributeSet());
+
+	Value *materializeLazyDecl(const std::string& name);
+
+	void removeLazyDecl(const std::string& name);
+
+	inline std::map<std::string, LazyDecl>&
+	getLazyDecls()
+	{
+		return lazy_decls;
+	}
+
+	void addLazyBody(Function *function, NFunctionDecl *func_decl);
+
+	void generateLazyBodies();
+
+	// warn about #pragma loop transformations the optimizer didn't do
+	void checkLoopPragmas();
+
+	void initDebugInfo(const std::string& file_name, bool optimized);
+	MDNode *getDebugFile(char *file_name);
+	void beginFunctionDebugInfo(Function *function, int lineno, char *file_name);
+	void endFunctionDebugInfo();
+	void setDebugLocation(int lineno, char *file_name);
+	void finalizeDebugInfo();
+
+	bool loadProfile(const std::string& file_name);
+	void beginFunctionProfile(Function *function);
+	void endFunctionProfile(Function *function, int lineno, char *file_name);
+	unsigned countBranch(Value *cond);
+	void setBranchWeights(Instruction *br, unsigned slot, int hint = 0);
+	unsigned countIndirectCall(Value *callee);
+	Function *getHotTarget(unsigned slot, FunctionType *ftype, MDNode **weights);
+	void finalizeProfile();
+
+	void finalizeLinkage();
+	void inferFunctionAttributes();
+
+	void setArithmeticMode(const ArithmeticMode& mode);
+
 	BasicBlock *getLabel(std::string name);
+	Value *getLabelAddress(BasicBlock *block);
+	void addIndirectGoto(IndirectBrInst *br);
+	void resolveIndirectGotos();
+	void addTailCall(CallInst *call);
+	void markTailCalls(Function *function);
 
 	FieldMap *getStruct(std::string name);
 
@@ -130,6 +300,8 @@ public:
 
 	void setUnion(std::string name, UnionFieldMap map);
 
+	const RecordLayout *getLayout(StructType *type);
+
 	Type *getType(std::string name);
 
 	void setType(std::string name, Type *type);
@@ -45,6 +45,8 @@ NDouble::codeGen(CodeGenContext& context)
 CGValue
 NString::codeGen(CodeGenContext& context)
 {
+	STATS_INC(string_literals);
+
 	if (context.currentBlock()) {
 		return CGValue(new GlobalVariable(*context.module,
 								   llvm::ArrayType::get(Type::getInt8Ty(getGlobalContext()), strlen(value.c_str()) + 1),
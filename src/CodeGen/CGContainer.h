@@ -9,71 +9,63 @@ enum ValueToken {
 	ExpressionListKind,
 };
 
+// set of ValueToken, one bit per token
 class ValueKind {
-	vector<ValueToken> tokens;
+	unsigned tokens = 0;
 
 public:
 
 	ValueKind()
 	{ }
 
-	ValueKind(ValueToken t1)
+	ValueKind(ValueToken t1,
+			  ValueToken t2 = NoneValueKind,
+			  ValueToken t3 = NoneValueKind)
 	{
-		tokens.push_back(t1);
-	}
-
-	ValueKind(ValueToken t1, ValueToken t2)
-	{
-		tokens.push_back(t1);
-		tokens.push_back(t2);
-	}
-
-	ValueKind(ValueToken t1, ValueToken t2, ValueToken t3)
-	{
-		tokens.push_back(t1);
-		tokens.push_back(t2);
-		tokens.push_back(t3);
+		addKind(t1, t2, t3);
 	}
 
 	void addKind(ValueToken t1,
 				 ValueToken t2 = NoneValueKind,
 				 ValueToken t3 = NoneValueKind)
 	{
-		tokens.push_back(t1);
-		if (t2) tokens.push_back(t2);
-		if (t3) tokens.push_back(t3);
+		tokens |= (1u << t1) | (1u << t2) | (1u << t3);
+		tokens &= ~(1u << NoneValueKind);
 		return;
 	}
 	
 	template <ValueToken VT>
-	bool hasKind()
+	bool hasKind() const
 	{
-		return find(tokens.begin(), tokens.end(), VT) != tokens.end();
+		return tokens & (1u << VT);
 	}
-
-
-	virtual ~ValueKind()
-	{ }
 };
 
+// trivially copyable, passed by value all over codegen
 class CGValue {
 	Value *data = NULL;
-	vector<Value *> exp_list;
+	Value *last_exp = NULL; // last value of an expression list
 	ValueKind kind;
 
 public:
 	CGValue() { }
 
 	CGValue(Value *val) :
-	data(val), exp_list(vector<Value *>())
+	data(val)
 	{ }
 
 	void pushExp(Value *val)
 	{
-		exp_list.push_back(val);
+		last_exp = val;
+		kind.addKind(ExpressionListKind);
 		return;
 	}
 
+	Value *getLastExp() const
+	{
+		return last_exp;
+	}
+
 	void addKind(ValueToken t1,
 				 ValueToken t2 = NoneValueKind,
 				 ValueToken t3 = NoneValueKind)
@@ -88,20 +80,16 @@ public:
 	}
 
 	template <ValueToken VT>
-	bool hasKind()
+	bool hasKind() const
 	{
 		return kind.hasKind<VT>();
 	}
 
 	inline
-	operator Value *()
+	operator Value *() const
 	{
 		return data;
 	}
-
-	virtual ~CGValue()
-	{
-	}
 };
 
 #endif
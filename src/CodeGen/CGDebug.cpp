@@ -0,0 +1,114 @@
+#include "AST/Node.h"
+#include "CGAST.h"
+#include <llvm/IR/DebugInfo.h>
+#include <llvm/Support/Dwarf.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+
+/*
+ * Line tables for -g: a compile unit, a subprogram for every function
+ * body and the line of the statement being lowered on each instruction.
+ * Types and variables are not described, profilers only need the lines.
+ */
+
+static std::string
+getDirectory(const std::string& file_name)
+{
+	SmallString<256> path(file_name);
+
+	sys::fs::make_absolute(path);
+
+	return sys::path::parent_path(path).str();
+}
+
+void
+CodeGenContext::initDebugInfo(const std::string& file_name, bool optimized)
+{
+	debug_builder = new DIBuilder(*module);
+	debug_unit = debug_builder->createCompileUnit(dwarf::DW_LANG_C99, sys::path::filename(file_name),
+												  getDirectory(file_name), "phi", optimized, "", 0,
+												  "", DIBuilder::LineTablesOnly);
+
+	module->addModuleFlag(Module::Warning, "Dwarf Version", 4);
+	module->addModuleFlag(Module::Warning, "Debug Info Version", DEBUG_METADATA_VERSION);
+
+	return;
+}
+
+MDNode *
+CodeGenContext::getDebugFile(char *file_name)
+{
+	std::string name = file_name ? file_name : "";
+
+	if (debug_files.find(name) == debug_files.end()) {
+		debug_files[name] = debug_builder->createFile(sys::path::filename(name), getDirectory(name));
+	}
+
+	return debug_files[name];
+}
+
+void
+CodeGenContext::beginFunctionDebugInfo(Function *function, int lineno, char *file_name)
+{
+	DIFile file;
+
+	if (!debug_builder) {
+		return;
+	}
+
+	file = DIFile(getDebugFile(file_name));
+	debug_subprogram = debug_builder->createFunction(file, function->getName(), function->getName(),
+													 file, lineno,
+													 debug_builder->createSubroutineType(file,
+														debug_builder->getOrCreateArray(None)),
+													 function->hasInternalLinkage(), true, lineno,
+													 DIDescriptor::FlagPrototyped,
+													 DICompileUnit(debug_unit).isOptimized(), function);
+
+	debug_scopes.clear();
+	debug_scopes[file_name ? file_name : ""] = debug_subprogram;
+	setDebugLocation(lineno, file_name);
+
+	return;
+}
+
+void
+CodeGenContext::endFunctionDebugInfo()
+{
+	debug_subprogram = NULL;
+	debug_scopes.clear();
+	builder->SetCurrentDebugLocation(DebugLoc());
+
+	return;
+}
+
+void
+CodeGenContext::setDebugLocation(int lineno, char *file_name)
+{
+	std::string name = file_name ? file_name : "";
+
+	if (!debug_subprogram || lineno < 0) { // keep the location of the enclosing statement
+		return;
+	}
+
+	// statements included from another file (line markers) get a lexical block file
+	if (debug_scopes.find(name) == debug_scopes.end()) {
+		debug_scopes[name] = debug_builder->createLexicalBlockFile(DIDescriptor(debug_subprogram),
+																   DIFile(getDebugFile(file_name)));
+	}
+	builder->SetCurrentDebugLocation(DebugLoc::get(lineno, 0, debug_scopes[name]));
+
+	return;
+}
+
+void
+CodeGenContext::finalizeDebugInfo()
+{
+	if (debug_builder) {
+		debug_builder->finalize();
+		delete debug_builder;
+		debug_builder = NULL;
+	}
+
+	return;
+}
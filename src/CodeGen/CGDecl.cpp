@@ -86,12 +86,11 @@ NVariableDecl::codeGen(CodeGenContext& context)
 	DeclaratorList::const_iterator decl_it;
 	DeclInfo *decl_info_tmp;
 	AllocaInst *alloc_inst;
-	NIdentifier *id;
-	NAssignmentExpr *assign;
 	Constant *init_value = NULL;
 	Type *main_type;
 	Type *tmp_type;
 	DeclSpecifier::const_iterator decl_spec_it;
+	unsigned align;
 
 	for (decl_spec_it = var_specifier.begin();
 		 decl_spec_it != var_specifier.end(); decl_spec_it++) {
@@ -99,6 +98,7 @@ NVariableDecl::codeGen(CodeGenContext& context)
 	}
 
 	main_type = specifiers->type->getType(context);
+	align = getAlignAttribute(context, &specifiers->attributes, getLine(this), getFile(this));
 
 	if (context.currentBlock()
 		&& specifiers->linkage != GlobalValue::ExternalLinkage) {
@@ -114,12 +114,13 @@ NVariableDecl::codeGen(CodeGenContext& context)
 			}
 
 			alloc_inst = context.builder->CreateAlloca(tmp_type, nullptr, decl_info_tmp->id->name.c_str());
+			if (align) {
+				alloc_inst->setAlignment(align);
+			}
 			context.getTopLocals()[decl_info_tmp->id->name] = alloc_inst;
 			if (decl_info_tmp->expr) {
-				id = new NIdentifier(*new string(decl_info_tmp->id->name));
-				assign = new NAssignmentExpr(*id, *decl_info_tmp->expr);
-				assign->codeGen(context);
-				delete assign;
+				NAssignmentExpr::emitStore(context, alloc_inst, *decl_info_tmp->expr,
+										   getLine(this), getFile(this));
 			}
 
 			delete decl_info_tmp;
@@ -134,9 +135,13 @@ NVariableDecl::codeGen(CodeGenContext& context)
 				if (specifiers->linkage == GlobalValue::CommonLinkage) {
 					specifiers->linkage = GlobalValue::ExternalLinkage;
 				}
-				Function::Create(dyn_cast<FunctionType>(tmp_type),
-								 specifiers->linkage,
-								 context.formatName(decl_info_tmp->id->name), context.module);
+				// prototypes are only emitted once they are referenced
+				if (!context.module->getFunction(context.formatName(decl_info_tmp->id->name))) {
+					context.addLazyDecl(context.formatName(decl_info_tmp->id->name),
+										tmp_type, specifiers->linkage,
+										getFunctionAttributes(&specifiers->attributes,
+															  dyn_cast<FunctionType>(tmp_type)->getReturnType()));
+				}
 			} else {
 				if (tmp_type->isVoidTy()) {
 					if (specifiers->linkage == GlobalValue::ExternalLinkage) {
@@ -151,11 +156,25 @@ NVariableDecl::codeGen(CodeGenContext& context)
 
 				if (specifiers->linkage != GlobalValue::ExternalLinkage) {
 					init_value = Constant::getNullValue(tmp_type);
+				} else if (!decl_info_tmp->expr) { // extern declaration, emitted once it is referenced
+					if (context.getGlobals().find(context.formatName(decl_info_tmp->id->name))
+						== context.getGlobals().end()) {
+						context.addLazyDecl(context.formatName(decl_info_tmp->id->name),
+											tmp_type, specifiers->linkage);
+					}
+					delete decl_info_tmp;
+					continue;
 				}
+				context.removeLazyDecl(context.formatName(decl_info_tmp->id->name));
 
 				var = new GlobalVariable(*context.module, tmp_type, false,
-										 specifiers->linkage,
+										 specifiers->linkage == GlobalValue::CommonLinkage && !context.common_globals
+										 ? GlobalValue::ExternalLinkage : specifiers->linkage,
 										 init_value, context.formatName(decl_info_tmp->id->name));
+				if (align) {
+					var->setAlignment(align);
+				}
+				setVisibility(context, var, &specifiers->attributes, getLine(this), getFile(this));
 
 				if (decl_info_tmp->expr) {
 					Value *tmp_val;
@@ -188,7 +207,6 @@ NVariableDecl::codeGen(CodeGenContext& context)
 						CGERR_showAllMsg(context);
 						return CGValue();
 					} */
-					delete decl_info_tmp->expr;
 				}
 
 				context.getGlobals()[context.formatName(decl_info_tmp->id->name)] = var;
@@ -220,7 +238,6 @@ NDelegateDecl::codeGen(CodeGenContext& context)
 CGValue
 NStructDecl::codeGen(CodeGenContext& context)
 {
-	unsigned i;
 	bool isAnon = false;
 	VariableList::const_iterator var_it;
 	DeclaratorList::const_iterator decl_it;
@@ -231,6 +248,8 @@ NStructDecl::codeGen(CodeGenContext& context)
 	Type *tmp_type;
 	DeclSpecifier::const_iterator decl_spec_it;
 	string real_name;
+	bool packed;
+	unsigned align;
 
 	if (!id.name.compare(".")) {
 		isAnon = true;
@@ -266,7 +285,14 @@ NStructDecl::codeGen(CodeGenContext& context)
 	}
 
 	if (fields) {
-		for (var_it = fields->begin(), i = 0;
+		// fields are laid out with their natural alignment unless the struct is packed
+		packed = findAttribute(attributes, "packed") != NULL;
+		align = getAlignAttribute(context, attributes, getLine(this), getFile(this));
+		if (align) {
+			field_types.push_back(getAlignFiller(align));
+		}
+
+		for (var_it = fields->begin();
 			 var_it != fields->end(); var_it++) {
 			for (decl_spec_it = (**var_it).var_specifier.begin();
 				 decl_spec_it != (**var_it).var_specifier.end(); decl_spec_it++) {
@@ -274,11 +300,17 @@ NStructDecl::codeGen(CodeGenContext& context)
 			}
 
 			tmp_type = (**var_it).specifiers->type->getType(context);
+			align = getAlignAttribute(context, &(**var_it).specifiers->attributes,
+									  getLine(*var_it), getFile(*var_it));
 			for (decl_it = (**var_it).declarator_list->begin();
-				 decl_it != (**var_it).declarator_list->end(); decl_it++, i++) {
+				 decl_it != (**var_it).declarator_list->end(); decl_it++) {
 				decl_info_tmp = (*decl_it)->getDeclInfo(context, tmp_type);
-				field_map[decl_info_tmp->id->name] = i;
+				if (align && !packed) {
+					field_types.push_back(getAlignFiller(align));
+				}
 
+				// fillers shift the element index of the following fields
+				field_map[decl_info_tmp->id->name] = field_types.size();
 				field_types.push_back(decl_info_tmp->type);
 
 				if (decl_info_tmp->expr) {
@@ -291,7 +323,7 @@ NStructDecl::codeGen(CodeGenContext& context)
 				delete decl_info_tmp;
 			}
 		}
-		struct_type->setBody(makeArrayRef(field_types), true);
+		struct_type->setBody(makeArrayRef(field_types), packed);
 		context.setStruct(struct_type->getStructName(), field_map);
 	}
 
@@ -348,8 +380,12 @@ NUnionDecl::codeGen(CodeGenContext& context)
 	}
 
 	if (fields) {
-		Type *max_sized_type = NULL;
+		Type *max_aligned_type = NULL;
 		uint64_t max_size = 0;
+		uint64_t max_align = 0;
+		uint64_t size;
+		unsigned align = getAlignAttribute(context, attributes, getLine(this), getFile(this));
+		bool packed = findAttribute(attributes, "packed") != NULL;
 
 		for (var_it = fields->begin(), i = 0;
 			 var_it != fields->end(); var_it++) {
@@ -368,21 +404,37 @@ NUnionDecl::codeGen(CodeGenContext& context)
 
 				field_map[decl_info_tmp->id->name] = tmp_type;
 
-				if (getConstantIntExprJIT(ConstantExpr::getSizeOf(tmp_type)) > max_size) {
-					max_sized_type = tmp_type;
+				size = getSizeOfJIT(tmp_type);
+				if (size > max_size) {
+					max_size = size;
+				}
+				size = getAlignOfJIT(tmp_type);
+				if (!max_aligned_type || size > max_align) {
+					max_aligned_type = tmp_type;
+					max_align = size;
 				}
 
 				if (decl_info_tmp->expr) {
 					CGERR_Initializer_Cannot_Be_In_Union(context);
-					CGERR_setLineNum(context, getLine(*var_it), getFile(*ver_it));
+					CGERR_setLineNum(context, getLine(*var_it), getFile(*var_it));
 					CGERR_showAllMsg(context);
 					return CGValue();
 				}
 				delete decl_info_tmp;
 			}
 		}
-		field_types.push_back(max_sized_type);
-		union_type->setBody(makeArrayRef(field_types), true);
+		// the most aligned member gives the alignment, the rest is padded up to the biggest one
+		if (align) {
+			field_types.push_back(getAlignFiller(align));
+		}
+		if (max_aligned_type) {
+			field_types.push_back(max_aligned_type);
+			size = getSizeOfJIT(max_aligned_type);
+			if (max_size > size) {
+				field_types.push_back(ArrayType::get(context.builder->getInt8Ty(), max_size - size));
+			}
+		}
+		union_type->setBody(makeArrayRef(field_types), packed);
 		context.setUnion(union_type->getStructName(), field_map);
 	}
 
@@ -402,6 +454,73 @@ NTypedefDecl::codeGen(CodeGenContext& context)
 	return CGValue();
 }
 
+NFunctionDecl *
+NFunctionDecl::moveLazyBody()
+{
+	NFunctionDecl *ret = new NFunctionDecl(func_specifier, decl, NULL);
+
+	((NStatement *)ret)->lineno = getLine(this);
+	((NStatement *)ret)->file_name = getFile(this);
+	ret->lazy_body = lazy_body;
+	ret->lazy_lineno = lazy_lineno;
+	ret->lazy_type_def = lazy_type_def;
+
+	lazy_body = NULL;
+	lazy_type_def = NULL;
+	specifiers->type = NULL; // owned by the specifier set of the new node after its codeGen
+	moved_from = true;
+
+	return ret;
+}
+
+// -finstrument-functions: report the entry and every return to the profiler runtime
+static void
+instrumentFunction(CodeGenContext& context, Function *function)
+{
+	FunctionType *hook_type = FunctionType::get(context.builder->getVoidTy(),
+												context.builder->getInt8PtrTy(), false);
+	Constant *enter_func = context.module->getOrInsertFunction(PROFILER_ENTER_NAME, hook_type);
+	Constant *exit_func = context.module->getOrInsertFunction(PROFILER_EXIT_NAME, hook_type);
+	BasicBlock::iterator first_inst = function->getEntryBlock().getFirstInsertionPt();
+	Function::iterator block_it;
+	Instruction *exit_point;
+	CallInst *call;
+	Value *name;
+
+	context.builder->SetInsertPoint(&function->getEntryBlock(), first_inst);
+	name = context.builder->CreateGlobalStringPtr(function->getName()); // also identifies the function
+	call = context.builder->CreateCall(enter_func, name);
+	call->setDebugLoc(first_inst->getDebugLoc());
+
+	for (block_it = function->begin(); block_it != function->end(); block_it++) {
+		if (isa<ReturnInst>(block_it->getTerminator())) {
+			exit_point = block_it->getTerminator();
+			if ((call = dyn_cast_or_null<CallInst>(exit_point->getPrevNode())) && call->isMustTailCall()) {
+				exit_point = call; // nothing may come between a musttail call and its ret
+			}
+			call = CallInst::Create(exit_func, name, "", exit_point);
+			call->setDebugLoc(exit_point->getDebugLoc());
+		}
+	}
+
+	return;
+}
+
+// hot and cold in the source win over what the profile said
+static void
+setFunctionAttributes(Function *function, AttributeSet attributes)
+{
+	if (attributes.hasAttribute(AttributeSet::FunctionIndex, Attribute::Cold)) {
+		function->removeFnAttr(Attribute::InlineHint);
+	} else if (attributes.hasAttribute(AttributeSet::FunctionIndex, Attribute::InlineHint)) {
+		function->removeFnAttr(Attribute::Cold);
+	}
+	function->addAttributes(AttributeSet::FunctionIndex, attributes);
+	function->addAttributes(AttributeSet::ReturnIndex, attributes);
+
+	return;
+}
+
 CGValue
 NFunctionDecl::codeGen(CodeGenContext& context)
 {
@@ -415,6 +534,8 @@ NFunctionDecl::codeGen(CodeGenContext& context)
 	Type *ret_type;
 	DeclInfo *decl_info_tmp;
 	DeclInfo *main_decl_info;
+	int function_lineno;
+	clock_t start_time = clock();
 
 	for (decl_spec_it = func_specifier.begin();
 		 decl_spec_it != func_specifier.end();
@@ -429,6 +550,7 @@ NFunctionDecl::codeGen(CodeGenContext& context)
 	if (specifiers->linkage == GlobalValue::CommonLinkage) {
 		specifiers->linkage = GlobalValue::ExternalLinkage;
 	}
+	context.materializeLazyDecl(context.formatName(main_decl_info->id->name));
 	if (!(function = context.module->getFunction(context.formatName(main_decl_info->id->name)))) {
 		function = Function::Create(ftype, specifiers->linkage,
 									context.formatName(main_decl_info->id->name), context.module);
@@ -451,6 +573,12 @@ NFunctionDecl::codeGen(CodeGenContext& context)
 		}
 	}
 
+	if (!block && lazy_body) { // body is parsed and generated once the function is referenced
+		context.addLazyBody(function, moveLazyBody());
+		delete main_decl_info;
+		return CGValue(function);
+	}
+
 	if (block) {
 		if (context.currentBlock()) {
 			CGERR_Nesting_Function(context);
@@ -466,9 +594,31 @@ NFunctionDecl::codeGen(CodeGenContext& context)
 			return CGValue();
 		}
 
+		// every unit including the definition emits it, the linker keeps one
+		if (specifiers->is_inline) {
+			if (!function->hasLocalLinkage()) {
+				function->setLinkage(GlobalValue::LinkOnceODRLinkage);
+			}
+			function->addFnAttr(specifiers->always_inline ? Attribute::AlwaysInline : Attribute::InlineHint);
+		}
+		setVisibility(context, function, &specifiers->attributes, getLine(this), getFile(this));
+
+		// the definition itself is reduced after its body, its name is not
+		function_lineno = main_decl_info->id->lineno >= 0 ? main_decl_info->id->lineno : getLine(this);
+		context.function_locations[function->getName().str()] = { function_lineno, getFile(this) };
+
 		bblock = BasicBlock::Create(getGlobalContext(), "", function, 0);
 		context.pushBlock(bblock);
 		context.builder->SetInsertPoint(context.currentBlock());
+		context.beginFunctionDebugInfo(function, function_lineno, getFile(this));
+		context.beginFunctionProfile(function);
+
+		context.setArithmeticMode(getArithmeticMode(context, &specifiers->attributes,
+													function_lineno, getFile(this)));
+		// read back by the backend per function, so optimize attributes apply there too
+		function->addFnAttr("unsafe-fp-math", context.arith.fast_math ? "true" : "false");
+		function->addFnAttr("no-infs-fp-math", context.arith.fast_math ? "true" : "false");
+		function->addFnAttr("no-nans-fp-math", context.arith.fast_math ? "true" : "false");
 
 		if (!context.formatName(main_decl_info->id->name).compare("main")) { // name is "main"
 			if (isInt32Type(function->getReturnType())) {
@@ -479,7 +629,6 @@ NFunctionDecl::codeGen(CodeGenContext& context)
 				CGERR_showAllMsg(context);
 			}
 
-			function->setDoesNotThrow();
 			function->setHasUWTable();
 			function->addFnAttr("no-frame-pointer-elim-non-leaf");
 		}
@@ -508,6 +657,8 @@ NFunctionDecl::codeGen(CodeGenContext& context)
 		context.in_param_flag--;
 
 		block->codeGen(context);
+		context.resolveIndirectGotos();
+		context.markTailCalls(function);
 		if (!context.currentBlock()->getTerminator()) {
 			if (ret_type->isVoidTy()) {
 				context.builder->CreateRetVoid();
@@ -518,7 +669,30 @@ NFunctionDecl::codeGen(CodeGenContext& context)
 				context.builder->CreateRet(Constant::getNullValue(function->getReturnType()));
 			}
 		}
+		if (context.instrument_functions
+			&& !findAttribute(&specifiers->attributes, "no_instrument_function")) {
+			instrumentFunction(context, function);
+		}
+		context.endFunctionProfile(function, function_lineno, getFile(this));
+		setFunctionAttributes(function, getFunctionAttributes(&specifiers->attributes, ret_type));
 		context.popAllBlock();
+		context.endFunctionDebugInfo();
+		context.setArithmeticMode(context.default_arith);
+
+		if (compiler_stats.enabled) {
+			compiler_stats.countFunction(function);
+		}
+		if (compiler_stats.track_costs) {
+			FunctionCost& cost = compiler_stats.getCost(function->getName().str());
+			Function::const_iterator block_it;
+
+			cost.file_name = getFile(this) ? getFile(this) : "";
+			cost.lineno = getLine(this);
+			cost.codegen_time = (double)(clock() - start_time) / CLOCKS_PER_SEC;
+			for (block_it = function->begin(); block_it != function->end(); block_it++) {
+				cost.ir_insts += block_it->size();
+			}
+		}
 	}
 
 	delete main_decl_info;
@@ -10,7 +10,7 @@
 DeclInfo *
 IdentifierDeclarator::getDeclInfo(CodeGenContext& context, llvm::Type *base_type)
 {
-	return new DeclInfo(base_type, new NIdentifier(*new string(id.name)));
+	return new DeclInfo(base_type, &id);
 }
 
 DeclInfo *
@@ -354,6 +354,62 @@ CGERR_Invalid_Use_Of_Void(CodeGenContext& context)
 	return;
 }
 
+inline void
+CGERR_Unknown_Loop_Hint(CodeGenContext& context, const char *name)
+{
+	context.messages.newMessage(new ErrorInfo(ErrorInfo::Warning, true, ErrorInfo::NoAct,
+											  "Unknown loop hint \"$(name)\" ignored", name));
+	return;
+}
+
+inline void
+CGERR_Invalid_Loop_Hint_Argument(CodeGenContext& context, const char *name)
+{
+	context.messages.newMessage(new ErrorInfo(ErrorInfo::Error, true, ErrorInfo::Exit1,
+											  "Invalid argument for loop hint \"$(name)\"", name));
+	return;
+}
+
+inline void
+CGERR_Loop_Hint_Not_Applied(CodeGenContext& context, const char *name)
+{
+	context.messages.newMessage(new ErrorInfo(ErrorInfo::Warning, true, ErrorInfo::NoAct,
+											  "Loop not transformed: requested $(name) was not applied", name));
+	return;
+}
+
+inline void
+CGERR_Profile_Mismatch(CodeGenContext& context, const char *name)
+{
+	context.messages.newMessage(new ErrorInfo(ErrorInfo::Warning, true, ErrorInfo::NoAct,
+											  "Profile of function $(name) does not match its source, ignored", name));
+	return;
+}
+
+inline void
+CGERR_Unknown_Optimize_Option(CodeGenContext& context, const char *name)
+{
+	context.messages.newMessage(new ErrorInfo(ErrorInfo::Warning, true, ErrorInfo::NoAct,
+											  "Unknown optimize attribute option \"$(name)\" ignored", name));
+	return;
+}
+
+inline void
+CGERR_Unknown_Visibility(CodeGenContext& context, const char *name)
+{
+	context.messages.newMessage(new ErrorInfo(ErrorInfo::Warning, true, ErrorInfo::NoAct,
+											  "Unknown visibility \"$(name)\" ignored", name));
+	return;
+}
+
+inline void
+CGERR_Invalid_Alignment(CodeGenContext& context)
+{
+	context.messages.newMessage(new ErrorInfo(ErrorInfo::Error, true, ErrorInfo::Exit1,
+											  "Requested alignment is not a constant power of 2"));
+	return;
+}
+
 inline void
 CGERR_Invalid_Use_Of_Incompelete_Type(CodeGenContext& context, const char *name)
 {
@@ -378,6 +434,54 @@ CGERR_Non_Constant_Initializer(CodeGenContext& context)
 	return;
 }
 
+inline void
+CGERR_Cannot_Tail_Call(CodeGenContext& context, const char *reason)
+{
+	context.messages.newMessage(new ErrorInfo(ErrorInfo::Error, true, ErrorInfo::Exit1,
+											  "Cannot guarantee tail call: $(reason)", reason));
+	return;
+}
+
+inline void
+CGERR_Invalid_Goto_Target(CodeGenContext& context)
+{
+	context.messages.newMessage(new ErrorInfo(ErrorInfo::Error, true, ErrorInfo::Exit1,
+											  "Target of goto * is not a pointer"));
+	return;
+}
+
+inline void
+CGERR_Case_Without_Switch(CodeGenContext& context)
+{
+	context.messages.newMessage(new ErrorInfo(ErrorInfo::Error, true, ErrorInfo::Exit1,
+											  "Used case or default label without switch statement"));
+	return;
+}
+
+inline void
+CGERR_Non_Constant_Case(CodeGenContext& context)
+{
+	context.messages.newMessage(new ErrorInfo(ErrorInfo::Error, true, ErrorInfo::Exit1,
+											  "Case label is not an integer constant"));
+	return;
+}
+
+inline void
+CGERR_Duplicate_Case(CodeGenContext& context)
+{
+	context.messages.newMessage(new ErrorInfo(ErrorInfo::Error, true, ErrorInfo::Exit1,
+											  "Duplicate case value or default label"));
+	return;
+}
+
+inline void
+CGERR_Invalid_Switch_Condition(CodeGenContext& context)
+{
+	context.messages.newMessage(new ErrorInfo(ErrorInfo::Error, true, ErrorInfo::Exit1,
+											  "Switch condition is not an integer"));
+	return;
+}
+
 inline void
 CGERR_Continue_Without_Iteration(CodeGenContext& context)
 {
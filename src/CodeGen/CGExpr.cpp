@@ -59,6 +59,15 @@ NIdentifier::codeGen(CodeGenContext& context)
 {
 	Function *func;
 
+	// a local shadows a lazy global of the same name, which must stay unmaterialized
+	if (context.currentBlock()
+		&& context.getTopLocals().find(name) != context.getTopLocals().end()) {
+		return codeGenLoadValue(context, context.getTopLocals()[name]);
+	}
+
+	context.materializeLazyDecl(context.formatName(name));
+	context.materializeLazyDecl(name);
+
 	if (context.getGlobals().find(context.formatName(name)) != context.getGlobals().end()) {
 		return codeGenLoadValue(context, context.getGlobals()[context.formatName(name)]);
 	}
@@ -67,10 +76,6 @@ NIdentifier::codeGen(CodeGenContext& context)
 		return codeGenLoadValue(context, context.getGlobals()[name]);
 	}
 
-	if (context.getTopLocals().find(name) != context.getTopLocals().end()) {
-		return codeGenLoadValue(context, context.getTopLocals()[name]);
-	}
-
 	if ((func = context.module->getFunction(context.formatName(name)))
 		|| (func = context.module->getFunction(name))) {
 		return CGValue(func);
@@ -82,20 +87,71 @@ NIdentifier::codeGen(CodeGenContext& context)
 	return CGValue();
 }
 
+// -fprofile-use: call the hot callee of an indirect call directly, so it can be inlined
+static Value *
+emitPromotedCall(CodeGenContext& context, Value *func_val, Function *target,
+				 ArrayRef<Value *> args, MDNode *weights)
+{
+	BasicBlock *orig_block = context.currentBlock();
+	BasicBlock *direct_block;
+	BasicBlock *indirect_block;
+	BasicBlock *end_block;
+	Value *direct;
+	Value *indirect;
+	PHINode *phi_node;
+
+	direct_block = BasicBlock::Create(getGlobalContext(), "", orig_block->getParent(),
+									  context.current_end_block);
+	indirect_block = BasicBlock::Create(getGlobalContext(), "", orig_block->getParent(),
+										context.current_end_block);
+	end_block = BasicBlock::Create(getGlobalContext(), "", orig_block->getParent(),
+								   context.current_end_block);
+
+	context.builder->CreateCondBr(context.builder->CreateICmpEQ(func_val,
+																ConstantExpr::getBitCast(target, func_val->getType())),
+								  direct_block, indirect_block, weights);
+
+	context.pushBlock(direct_block);
+	context.builder->SetInsertPoint(direct_block);
+	direct = context.builder->CreateCall(target, args, "");
+	context.builder->CreateBr(end_block);
+
+	context.pushBlock(indirect_block);
+	context.builder->SetInsertPoint(indirect_block);
+	indirect = context.builder->CreateCall(func_val, args, "");
+	context.builder->CreateBr(end_block);
+
+	context.pushBlock(end_block);
+	context.builder->SetInsertPoint(end_block);
+	if (direct->getType()->isVoidTy()) {
+		return indirect;
+	}
+
+	phi_node = context.builder->CreatePHI(direct->getType(), 2);
+	phi_node->addIncoming(direct, direct_block);
+	phi_node->addIncoming(indirect, indirect_block);
+
+	return phi_node;
+}
+
 CGValue
 NMethodCall::codeGen(CodeGenContext& context)
 {
 	int i;
 	Value *func_val = func_expr.codeGen(context);
 	Value *tmp;
-	Function *proto;
-	std::vector<Value*> args;
+	SmallVector<Value *, 8> args;
 	ExpressionList::const_iterator expr_it;
 	Type::subtype_iterator arg_it;
 	FunctionType *ftype;
 	CallInst *call;
 	Type *arg_type;
+	Function *target;
+	MDNode *weights;
+	unsigned profile_slot;
+	bool must_tail = context.must_tail; // not the calls in the arguments
 
+	context.must_tail = false;
 	if (context.isLValue()) {
 		CGERR_Function_Call_As_LValue(context);
 		CGERR_setLineNum(context, getLine(this), getFile(this));
@@ -113,9 +169,6 @@ NMethodCall::codeGen(CodeGenContext& context)
 		return CGValue();
 	}
 
-	proto = Function::Create(ftype,
-							 GlobalValue::InternalLinkage);
-
 	for (expr_it = arguments.begin(), arg_it = ftype->param_begin();
 		 expr_it != arguments.end() && (arg_it != ftype->param_end() || ftype->isVarArg());
 		 expr_it++, (arg_it != ftype->param_end() ? arg_it++ : 0)) {
@@ -137,8 +190,15 @@ NMethodCall::codeGen(CodeGenContext& context)
 		return CGValue();
 	}
 
+	if (!isa<Constant>(func_val)) { // through a delegate or a function pointer
+		profile_slot = context.countIndirectCall(func_val);
+		// a guarded direct call would not be the one call before the ret
+		if (!must_tail && (target = context.getHotTarget(profile_slot, ftype, &weights))) {
+			return CGValue(emitPromotedCall(context, func_val, target, makeArrayRef(args), weights));
+		}
+	}
+
 	call = context.builder->CreateCall(func_val, makeArrayRef(args), "");
-	delete proto;
 
 	return CGValue(call);
 }
@@ -158,9 +218,10 @@ doBinaryCast(CodeGenContext& context, Value* &lhs, Value* &rhs)
 		rtype = rhs->getType();
 	}
 
-	if (ltype->isPointerTy() && rtype->isPointerTy()) {
-		lhs = context.builder->CreatePtrToInt(lhs, context.builder->getInt64Ty(), "");
-		rhs = context.builder->CreatePtrToInt(rhs, context.builder->getInt64Ty(), "");
+	if (ltype->isPointerTy() && rtype->isPointerTy()) { // kept as pointers, see emitPointerBinary
+		if (ltype != rtype) {
+			rhs = context.builder->CreateBitCast(rhs, ltype, "");
+		}
 		return;
 	}
 
@@ -216,8 +277,11 @@ emitLogicalExpr(CodeGenContext& context, NExpression &lval, NExpression &rval, b
 	BasicBlock *lhs_end;
 	BasicBlock *orig_block;
 	PHINode *phi_node;
+	BranchInst *br;
+	unsigned profile_slot;
 
 	lhs = context.builder->CreateIsNotNull(lval.codeGen(context));
+	profile_slot = context.countBranch(lhs);
 	orig_block = context.currentBlock();
 
 	lhs_true = BasicBlock::Create(getGlobalContext(), "", orig_block->getParent(),
@@ -226,10 +290,11 @@ emitLogicalExpr(CodeGenContext& context, NExpression &lval, NExpression &rval, b
 								 context.current_end_block);
 
 	if (is_or) {
-		context.builder->CreateCondBr(lhs, lhs_end, lhs_true);
+		br = context.builder->CreateCondBr(lhs, lhs_end, lhs_true);
 	} else {
-		context.builder->CreateCondBr(lhs, lhs_true, lhs_end);
+		br = context.builder->CreateCondBr(lhs, lhs_true, lhs_end);
 	}
+	context.setBranchWeights(br, profile_slot, lval.getBranchHint());
 
 	setBlock(lhs_true);
 
@@ -245,6 +310,35 @@ emitLogicalExpr(CodeGenContext& context, NExpression &lval, NExpression &rval, b
 	return phi_node;
 }
 
+// with fp contraction a * b + c becomes llvm.fmuladd, fused where the target has FMA
+static Value *
+emitFMulAdd(CodeGenContext& context, Value *lhs, Value *rhs, bool is_sub)
+{
+	BinaryOperator *mul;
+	Value *mul_lhs;
+	Value *addend;
+	Value *ret;
+
+	if ((mul = dyn_cast<BinaryOperator>(lhs))
+		&& mul->getOpcode() == Instruction::FMul && mul->use_empty()) {
+		mul_lhs = mul->getOperand(0);
+		addend = is_sub ? context.builder->CreateFNeg(rhs) : rhs;
+	} else if ((mul = dyn_cast<BinaryOperator>(rhs))
+			   && mul->getOpcode() == Instruction::FMul && mul->use_empty()) {
+		mul_lhs = is_sub ? context.builder->CreateFNeg(mul->getOperand(0)) : mul->getOperand(0);
+		addend = lhs;
+	} else {
+		return NULL;
+	}
+
+	ret = context.builder->CreateCall3(Intrinsic::getDeclaration(context.module, Intrinsic::fmuladd,
+																 lhs->getType()),
+									   mul_lhs, mul->getOperand(1), addend);
+	mul->eraseFromParent();
+
+	return ret;
+}
+
 inline bool
 pointerAllowedExpr(int op)
 {
@@ -256,11 +350,46 @@ pointerAllowedExpr(int op)
 	return false;
 }
 
+inline bool
+isCompareOperator(int op)
+{
+	switch (op) {
+		case TCEQ:
+		case TCNE:
+		case TCLT:
+		case TCGT:
+		case TCLE:
+		case TCGE:
+			return true;
+	}
+	return false;
+}
+
+// pointer - pointer and pointer comparisons, done on the pointers
+// themselves so that alias analysis can still see where they come from
+static Value *
+emitPointerBinary(CodeGenContext& context, int op, Value *lhs, Value *rhs)
+{
+	switch (op) {
+		case TSUB:
+			return context.builder->CreatePtrDiff(lhs, rhs, ""); // exact sdiv by the element size
+		case TCEQ:		return context.builder->CreateICmpEQ(lhs, rhs, "");
+		case TCNE:		return context.builder->CreateICmpNE(lhs, rhs, "");
+		case TCLT:		return context.builder->CreateICmpULT(lhs, rhs, "");
+		case TCGT:		return context.builder->CreateICmpUGT(lhs, rhs, "");
+		case TCLE:		return context.builder->CreateICmpULE(lhs, rhs, "");
+		case TCGE:		return context.builder->CreateICmpUGE(lhs, rhs, "");
+	}
+
+	return NULL;
+}
+
 CGValue
 NBinaryExpr::codeGen(CodeGenContext& context)
 {
 	Value *lhs;
 	Value *rhs;
+	Value *fused;
 
 	if (op == TLAND) {
 		return CGValue(emitLogicalExpr(context, lval, rval, false));
@@ -271,6 +400,12 @@ NBinaryExpr::codeGen(CodeGenContext& context)
 	lhs = lval.codeGen(context);
 	rhs = rval.codeGen(context);
 
+	if (op == TADD // n + p is p + n
+		&& lhs->getType()->isIntegerTy()
+		&& (rhs->getType()->isPointerTy() || rhs->getType()->isArrayTy())) {
+		std::swap(lhs, rhs);
+	}
+
 	if ((lhs->getType()->isPointerTy() || lhs->getType()->isArrayTy())
 		&& rhs->getType()->isIntegerTy()
 		&& pointerAllowedExpr(op)) {
@@ -299,8 +434,28 @@ NBinaryExpr::codeGen(CodeGenContext& context)
 		return CGValue(context.builder->CreateInBoundsGEP(lhs, rhs, ""));
 	}
 
+	// p == 0 and the like compare against a null pointer
+	if (isCompareOperator(op)) {
+		if (lhs->getType()->isPointerTy() && rhs->getType()->isIntegerTy()) {
+			rhs = context.builder->CreateIntToPtr(rhs, lhs->getType(), "");
+		} else if (rhs->getType()->isPointerTy() && lhs->getType()->isIntegerTy()) {
+			lhs = context.builder->CreateIntToPtr(lhs, rhs->getType(), "");
+		}
+	}
+
 	doBinaryCast(context, lhs, rhs);
 
+	if (lhs->getType()->isPointerTy() && rhs->getType()->isPointerTy()) {
+		Value *ret = emitPointerBinary(context, op, lhs, rhs);
+		if (ret) {
+			return CGValue(ret);
+		}
+
+		// bitwise operations still need integers
+		lhs = context.builder->CreatePtrToInt(lhs, context.builder->getInt64Ty(), "");
+		rhs = context.builder->CreatePtrToInt(rhs, context.builder->getInt64Ty(), "");
+	}
+
 	switch (op) {
 		case TOR:
 			return CGValue(context.builder->CreateOr(lhs, rhs, ""));	
@@ -312,8 +467,16 @@ NBinaryExpr::codeGen(CodeGenContext& context)
 
 	if (lhs->getType()->isFloatingPointTy() && rhs->getType()->isFloatingPointTy()) {
 		switch (op) {
-			case TADD: 		return CGValue(context.builder->CreateFAdd(lhs, rhs, ""));
-			case TSUB:	 	return CGValue(context.builder->CreateFSub(lhs, rhs, ""));
+			case TADD:
+				if (context.arith.fp_contract && (fused = emitFMulAdd(context, lhs, rhs, false))) {
+					return CGValue(fused);
+				}
+				return CGValue(context.builder->CreateFAdd(lhs, rhs, ""));
+			case TSUB:
+				if (context.arith.fp_contract && (fused = emitFMulAdd(context, lhs, rhs, true))) {
+					return CGValue(fused);
+				}
+				return CGValue(context.builder->CreateFSub(lhs, rhs, ""));
 			case TMUL: 		return CGValue(context.builder->CreateFMul(lhs, rhs, ""));
 			case TDIV: 		return CGValue(context.builder->CreateFDiv(lhs, rhs, ""));
 			case TMOD: 		return CGValue(context.builder->CreateFRem(lhs, rhs, ""));
@@ -332,9 +495,12 @@ NBinaryExpr::codeGen(CodeGenContext& context)
 		}
 	} else if (lhs->getType()->isIntegerTy() && rhs->getType()->isIntegerTy()) {
 		switch (op) {
-			case TADD: 		return CGValue(context.builder->CreateAdd(lhs, rhs, ""));
-			case TSUB: 		return CGValue(context.builder->CreateSub(lhs, rhs, ""));
-			case TMUL: 		return CGValue(context.builder->CreateMul(lhs, rhs, ""));
+			case TADD: 		return CGValue(context.builder->CreateAdd(lhs, rhs, "", false,
+																	  hasNoSignedWrap(context, lhs->getType())));
+			case TSUB: 		return CGValue(context.builder->CreateSub(lhs, rhs, "", false,
+																	  hasNoSignedWrap(context, lhs->getType())));
+			case TMUL: 		return CGValue(context.builder->CreateMul(lhs, rhs, "", false,
+																	  hasNoSignedWrap(context, lhs->getType())));
 			case TDIV: 		return CGValue(context.builder->CreateSDiv(lhs, rhs, ""));
 			case TMOD: 		return CGValue(context.builder->CreateSRem(lhs, rhs, ""));
 			case TSHL:		return CGValue(context.builder->CreateShl(lhs, rhs, ""));
@@ -510,7 +676,8 @@ NPrefixExpr::codeGen(CodeGenContext& context)
 			case TINC: {
 				Value *add_inst;
 				add_inst = context.builder->CreateAdd(val_tmp,
-													  ConstantInt::get(val_type, 1));
+													  ConstantInt::get(val_type, 1), "",
+													  false, hasNoSignedWrap(context, val_type));
 				context.builder->CreateStore(add_inst,
 											 val_ptr);
 				return CGValue(add_inst);
@@ -519,7 +686,8 @@ NPrefixExpr::codeGen(CodeGenContext& context)
 			case TDEC: {
 				Value *sub_inst;
 				sub_inst = context.builder->CreateSub(val_tmp,
-													  ConstantInt::get(val_type, 1));
+													  ConstantInt::get(val_type, 1), "",
+													  false, hasNoSignedWrap(context, val_type));
 				context.builder->CreateStore(sub_inst,
 											 val_ptr);
 				return CGValue(sub_inst);
@@ -530,7 +698,7 @@ NPrefixExpr::codeGen(CodeGenContext& context)
 				break;
 			case TSUB:
 				return CGValue(context.builder->CreateSub(Constant::getNullValue(val_type),
-												   val_tmp, ""));
+												   val_tmp, "", false, hasNoSignedWrap(context, val_type)));
 			case TNOT:
 				return CGValue(context.builder->CreateNot(val_tmp, ""));
 		}
@@ -542,6 +710,50 @@ NPrefixExpr::codeGen(CodeGenContext& context)
 	return CGValue();
 }
 
+CGValue
+NLabelAddressExpr::codeGen(CodeGenContext& context)
+{
+	BasicBlock *labeled_block;
+
+	if (!(labeled_block = context.getLabel(label_name))) {
+		labeled_block = BasicBlock::Create(getGlobalContext(), "",
+										   context.currentBlock()->getParent(),
+										   context.current_end_block);
+		context.setLabel(label_name, labeled_block);
+	}
+
+	return CGValue(context.getLabelAddress(labeled_block));
+}
+
+int
+NPrefixExpr::getBranchHint()
+{
+	return op == TLNOT ? -operand.getBranchHint() : 0;
+}
+
+// only a hint where it is branched on, the value passes through
+CGValue
+NExpectExpr::codeGen(CodeGenContext& context)
+{
+	Value *val = operand.codeGen(context);
+	Value *expected_val;
+
+	if (!val) {
+		return CGValue();
+	}
+
+	if (!expected) { // likely and unlikely are as !!x
+		return CGValue(context.builder->CreateIsNotNull(val));
+	}
+
+	expected_val = expected->codeGen(context);
+	if (expected_val && isa<ConstantInt>(expected_val)) {
+		hint = dyn_cast<ConstantInt>(expected_val)->isZero() ? -1 : 1;
+	}
+
+	return CGValue(val);
+}
+
 #define NUM_MIN(a, b) (a < b ? a : b)
 
 template <typename T>
@@ -703,12 +915,34 @@ NAssignmentExpr::doAssignCast(CodeGenContext& context, Value *value,
 	return value;
 }
 
+// cast the value of rval to the type pointed by ptr and store it there
+Value *
+NAssignmentExpr::emitStore(CodeGenContext& context, Value *ptr, NExpression& rval,
+						   int lineno, char *file_name)
+{
+	Value *rhs;
+
+	if (isIntegerPointer(ptr)) {
+		context.current_bit_width = ptr->getType()->getPointerElementType()->getIntegerBitWidth();
+	}
+	rhs = rval.codeGen(context);
+	context.current_bit_width = 0;
+
+	rhs = NAssignmentExpr::doAssignCast(context, rhs,
+										ptr->getType()->getPointerElementType(), ptr,
+										lineno, file_name);
+
+	if (rhs) {
+		context.builder->CreateStore(rhs, ptr, false);
+	}
+
+	return rhs;
+}
+
 CGValue
 NAssignmentExpr::codeGen(CodeGenContext& context)
 {
 	Value *lhs;
-	Value *rhs;
-	Type *integer_type;
 
 	context.setLValue();
 	lhs = lval.codeGen(context);
@@ -724,24 +958,7 @@ NAssignmentExpr::codeGen(CodeGenContext& context)
 		return CGValue();
 	}
 
-	if (isIntegerPointer(lhs)) {
-		integer_type = dyn_cast<IntegerType>(lhs->getType()->getPointerElementType());
-		context.current_bit_width = integer_type->getIntegerBitWidth();
-	}
-	rhs = rval.codeGen(context);
-	context.current_bit_width = 0;
-
-	rhs = NAssignmentExpr::doAssignCast(context, rhs,
-										lhs->getType()->getPointerElementType(), lhs,
-										getLine(this), getFile(this));
-
-	if (!rhs) {
-		return CGValue(rhs);
-	}
-
-	context.builder->CreateStore(rhs, lhs, false);
-
-	return CGValue(rhs);
+	return CGValue(emitStore(context, lhs, rval, getLine(this), getFile(this)));
 }
 
 CGValue
@@ -749,10 +966,9 @@ NFieldExpr::codeGen(CodeGenContext& context)
 {
 	Value *ret;
 	Value *struct_value;
-	Type *struct_type;
-	FieldMap map;
-	UnionFieldMap union_map;
-	bool is_union_flag = false;
+	StructType *struct_type;
+	const RecordLayout *layout;
+	const FieldLayout *field;
 
 	if (context.isLValue()) {
 		struct_value = operand.codeGen(context);
@@ -763,7 +979,7 @@ NFieldExpr::codeGen(CodeGenContext& context)
 	}
 
 	if (isStructPointer(struct_value)) {
-		struct_type = struct_value->getType()->getPointerElementType();
+		struct_type = dyn_cast<StructType>(struct_value->getType()->getPointerElementType());
 	} else {
 		CGERR_Get_Non_Structure_Type_Field(context);
 		CGERR_setLineNum(context, getLine(this), getFile(this));
@@ -771,45 +987,24 @@ NFieldExpr::codeGen(CodeGenContext& context)
 		return CGValue();
 	}
 
-	if (!struct_type->getStructName().substr(0, strlen(UNION_PREFIX)).compare(UNION_PREFIX)) { // prefix is "union." ?
-		is_union_flag = true;
-		if (!context.getUnion(struct_type->getStructName())) {
-			CGERR_Invalid_Use_Of_Incompelete_Type(context, struct_type->getStructName().str().c_str());
-			CGERR_setLineNum(context, getLine(this), getFile(this));
-			CGERR_showAllMsg(context);
-			return CGValue();
-		}
-		union_map = *context.getUnion(struct_type->getStructName());
-	} else {
-		if (!context.getStruct(struct_type->getStructName())) {
-			CGERR_Invalid_Use_Of_Incompelete_Type(context, struct_type->getStructName().str().c_str());
-			CGERR_setLineNum(context, getLine(this), getFile(this));
-			CGERR_showAllMsg(context);
-			return CGValue();
-		}
+	if (!(layout = context.getLayout(struct_type))) {
+		CGERR_Invalid_Use_Of_Incompelete_Type(context, struct_type->getStructName().str().c_str());
+		CGERR_setLineNum(context, getLine(this), getFile(this));
+		CGERR_showAllMsg(context);
+		return CGValue();
+	}
 
-		map = *context.getStruct(struct_type->getStructName());
+	if (!(field = layout->getField(field_name.name))) {
+		CGERR_Failed_To_Find_Field_Name(context, field_name.name.c_str());
+		CGERR_setLineNum(context, getLine(this), getFile(this));
+		CGERR_showAllMsg(context);
+		return CGValue();
 	}
 
-	if (is_union_flag) {
-		if (union_map.find(field_name.name) != union_map.end()) {
-			ret = context.builder->CreateBitCast(struct_value, union_map[field_name.name]->getPointerTo(),
-												 "");
-		} else {
-			CGERR_Failed_To_Find_Field_Name(context, field_name.name.c_str());
-			CGERR_setLineNum(context, getLine(this), getFile(this));
-			CGERR_showAllMsg(context);
-			return CGValue();
-		}
+	if (layout->is_union) {
+		ret = context.builder->CreateBitCast(struct_value, field->type->getPointerTo(), "");
 	} else {
-		if (map.find(field_name.name) != map.end()) {
-			ret = context.builder->CreateStructGEP(struct_value, map[field_name.name], "");
-		} else {
-			CGERR_Failed_To_Find_Field_Name(context, field_name.name.c_str());
-			CGERR_setLineNum(context, getLine(this), getFile(this));
-			CGERR_showAllMsg(context);
-			return CGValue();
-		}
+		ret = context.builder->CreateStructGEP(struct_value, field->index, "");
 	}
 
 	return CGValue(codeGenLoadValue(context, ret));
@@ -922,7 +1117,8 @@ NIncDecExpr::codeGen(CodeGenContext& context)
 			case TINC: {
 				Value *add_inst;
 				add_inst = context.builder->CreateAdd(val_tmp,
-													  ConstantInt::get(val_type, 1));
+													  ConstantInt::get(val_type, 1), "",
+													  false, hasNoSignedWrap(context, val_type));
 				context.builder->CreateStore(add_inst,
 											 val_ptr);
 				break;
@@ -930,7 +1126,8 @@ NIncDecExpr::codeGen(CodeGenContext& context)
 			case TDEC: {
 				Value *sub_inst;
 				sub_inst = context.builder->CreateSub(val_tmp,
-													  ConstantInt::get(val_type, 1));
+													  ConstantInt::get(val_type, 1), "",
+													  false, hasNoSignedWrap(context, val_type));
 				context.builder->CreateStore(sub_inst,
 											 val_ptr);
 				break;
@@ -941,62 +1138,24 @@ NIncDecExpr::codeGen(CodeGenContext& context)
 	return CGValue(val_tmp);
 }
 
-void
-NCondExpr::castCompare(CodeGenContext& context,
-					   llvm::BasicBlock *lhs_true, llvm::Value *&lhs,
-					   llvm::BasicBlock *lhs_else, llvm::Value *&rhs)
+// cast an arm of the conditional expression to the type of the whole expression
+static Value *
+castCondArm(CodeGenContext& context, Value *val, Type *type)
 {
-	if (lhs->getType() == rhs->getType()) return;
-
-	if (lhs->getType()->isIntegerTy()
-		&& rhs->getType()->isIntegerTy()) { // int to int
-		if (getBitWidth(rhs->getType())
-			> getBitWidth(lhs->getType())) {
-			setBlock(lhs_true);
-			lhs = context.builder->CreateIntCast(lhs, rhs->getType(), true);
-			return;
-		} else {
-			setBlock(lhs_else);
-			rhs = context.builder->CreateIntCast(rhs, lhs->getType(), true);
-			return;
-		}
-	} else if (lhs->getType()->isFloatingPointTy()
-				&& rhs->getType()->isFloatingPointTy()) {
-		if (rhs->getType()->getTypeID()
-			> lhs->getType()->getTypeID()) {
-			setBlock(lhs_true);
-			lhs = context.builder->CreateFPCast(lhs, rhs->getType());
-			return;
-		} else {
-			setBlock(lhs_else);
-			rhs = context.builder->CreateFPCast(rhs, lhs->getType());
-			return;
-		}
-	} else if (lhs->getType()->isFloatingPointTy()
-				&& rhs->getType()->isIntegerTy()) {
-		setBlock(lhs_else);
-		rhs = context.builder->CreateSIToFP(rhs, lhs->getType());
-		return;
-	} else if (lhs->getType()->isIntegerTy()
-				&& rhs->getType()->isFloatingPointTy()) {
-		setBlock(lhs_true);
-		lhs = context.builder->CreateSIToFP(lhs, rhs->getType());
-		return;
-	} else {
-		setBlock(lhs_else);
-		rhs = context.builder->CreateBitCast(rhs, lhs->getType());
-		return;
+	if (!val || !type || val->getType() == type) {
+		return val;
 	}
 
-	return;
-}
+	if (val->getType()->isIntegerTy() && type->isIntegerTy()) {
+		return context.builder->CreateIntCast(val, type, true);
+	} else if (val->getType()->isFloatingPointTy() && type->isFloatingPointTy()) {
+		return context.builder->CreateFPCast(val, type);
+	} else if (val->getType()->isIntegerTy() && type->isFloatingPointTy()) {
+		return context.builder->CreateSIToFP(val, type);
+	}
 
-#define _lhs_getParent_O2_ (dyn_cast<Instruction>(lhs) ? \
-							dyn_cast<Instruction>(lhs)->getParent() :\
-							lhs_true) // only use in condition expression
-#define _rhs_getParent_O2_ (dyn_cast<Instruction>(rhs) ? \
-							dyn_cast<Instruction>(rhs)->getParent() :\
-							lhs_else) // only use in condition expression
+	return context.builder->CreateBitCast(val, type);
+}
 
 CGValue
 NCondExpr::codeGen(CodeGenContext& context)
@@ -1004,12 +1163,15 @@ NCondExpr::codeGen(CodeGenContext& context)
 	Value *cond_val;
 	Value *lhs;
 	Value *rhs;
+	Type *result_type;
 	BasicBlock *lhs_true;
 	BasicBlock *lhs_else;
 	BasicBlock *lhs_end;
 	BasicBlock *orig_block;
 	BasicBlock *orig_end_block;
 	PHINode *phi_node;
+	BranchInst *br;
+	unsigned profile_slot;
 
 	if (context.isLValue()) {
 		context.resetLValue();
@@ -1018,6 +1180,10 @@ NCondExpr::codeGen(CodeGenContext& context)
 	} else {
 		cond_val = context.builder->CreateIsNotNull(cond.codeGen(context));
 	}
+	profile_slot = context.countBranch(cond_val);
+
+	// known up front, so each arm is cast before it branches to the end
+	result_type = getExprType(context);
 
 	orig_block = context.currentBlock();
 	orig_end_block = context.current_end_block;
@@ -1030,26 +1196,25 @@ NCondExpr::codeGen(CodeGenContext& context)
 								 context.current_end_block);
 
 	context.current_end_block = lhs_end;
-	context.builder->CreateCondBr(cond_val, lhs_true, lhs_else);
+	br = context.builder->CreateCondBr(cond_val, lhs_true, lhs_else);
+	context.setBranchWeights(br, profile_slot, cond.getBranchHint());
 
 	setBlock(lhs_true);
-	lhs = if_true.codeGen(context);
+	lhs = castCondArm(context, if_true.codeGen(context), result_type);
+	lhs_true = context.currentBlock();
 	context.builder->CreateBr(lhs_end);
 
 	setBlock(lhs_else);
-	rhs = if_else.codeGen(context);
+	rhs = castCondArm(context, if_else.codeGen(context), result_type);
+	lhs_else = context.currentBlock();
 	context.builder->CreateBr(lhs_end);
 
-	if (!context.currentBlock()->getTerminator()) {
-		context.builder->CreateBr(lhs_end);
-	}
-	castCompare(context, lhs_true, lhs, lhs_else, rhs);
 	setBlock(lhs_end);
 	
 	phi_node = context.builder->CreatePHI(lhs->getType(), 2);
 
-	phi_node->addIncoming(lhs, _lhs_getParent_O2_);
-	phi_node->addIncoming(rhs, _rhs_getParent_O2_);
+	phi_node->addIncoming(lhs, lhs_true);
+	phi_node->addIncoming(rhs, lhs_else);
 
 	context.current_end_block = orig_end_block;
 
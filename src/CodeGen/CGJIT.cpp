@@ -41,6 +41,8 @@ getConstantIntExprJIT(Constant *const_expr)
 		(Value *)const_expr
 	};
 
+	STATS_INC(const_expr_jit);
+
 	ftype = FunctionType::get(Type::getInt32Ty(getGlobalContext()), false);
 	mainFunc = Function::Create(ftype,
 								GlobalValue::InternalLinkage,
@@ -0,0 +1,616 @@
+#include "CGPCH.h"
+#include <set>
+#include <sstream>
+#include <fstream>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+extern std::map<std::string, int> type_def;
+
+uint64_t
+hashPCHText(const char *text, size_t length, uint64_t hash)
+{
+	size_t i;
+
+	for (i = 0; i < length; i++) {
+		hash ^= (unsigned char)text[i];
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+static bool
+hashFile(const string& path, uint64_t& hash)
+{
+	ErrorOr<std::unique_ptr<MemoryBuffer> > buffer = MemoryBuffer::getFile(path);
+
+	if (!buffer) {
+		return false;
+	}
+	hash = hashPCHText((*buffer)->getBufferStart(), (*buffer)->getBufferSize());
+
+	return true;
+}
+
+// returns the end of the quoted file name if the line is a line marker
+static const char *
+scanLineMarker(const char *line, const char *line_end, const char *&name_begin)
+{
+	const char *p;
+
+	for (p = line; p < line_end && (*p == ' ' || *p == '\t'); p++);
+	if (p >= line_end || *p++ != '#') {
+		return NULL;
+	}
+	for (; p < line_end && (*p == ' ' || *p == '\t'); p++);
+	if (p >= line_end || !isdigit(*p)) {
+		return NULL;
+	}
+	for (; p < line_end && isdigit(*p); p++);
+	for (; p < line_end && (*p == ' ' || *p == '\t'); p++);
+	if (p >= line_end || *p != '"') {
+		return NULL;
+	}
+
+	name_begin = p + 1;
+	return (const char *)memchr(name_begin, '"', line_end - name_begin);
+}
+
+// line markers look like: # <line> "<file>" <flags>...
+// flag 2 means returning to <file> from an included one
+// the prefix is keyed on the header contents and on its markers and main file
+// code without line numbers, which move with any edit above the last #include
+bool
+PCHPrefix::scan(const string& preprocessed_path)
+{
+	ErrorOr<std::unique_ptr<MemoryBuffer> > buffer = MemoryBuffer::getFile(preprocessed_path);
+	const char *text, *end, *line, *line_end, *p;
+	const char *name_begin, *name_end;
+	vector<pair<string, uint64_t> > seen; // header path, offset of its first marker
+	vector<pair<string, uint64_t> >::const_iterator seen_it;
+	set<string> seen_names;
+	string name;
+	string current_file;
+	istringstream flags;
+	int flag;
+	uint64_t header_hash;
+	uint64_t running_hash = hashPCHText(NULL, 0);
+
+	if (!buffer) {
+		return false;
+	}
+	text = (*buffer)->getBufferStart();
+	end = (*buffer)->getBufferEnd();
+
+	for (line = text; line < end; line = line_end + 1) {
+		if (!(line_end = (const char *)memchr(line, '\n', end - line))) {
+			line_end = end;
+		}
+
+		if (!(name_end = scanLineMarker(line, line_end, name_begin))) {
+			if (current_file == main_file) {
+				for (p = line; p < line_end && isspace(*p); p++);
+				if (p < line_end) {
+					running_hash = hashPCHText(line, line_end - line, running_hash);
+					running_hash = hashPCHText("\n", 1, running_hash);
+				}
+			}
+			continue;
+		}
+		name = current_file = string(name_begin, name_end);
+
+		if (main_file.empty()) {
+			main_file = name;
+		} else if (name == main_file) {
+			flags.clear();
+			flags.str(string(name_end + 1, line_end));
+			while (flags >> flag) {
+				if (flag == 2) {
+					length = line - text;
+					includes_hash = running_hash;
+				}
+			}
+		} else {
+			running_hash = hashPCHText(name_begin, line_end - name_begin, running_hash); // name and flags
+			running_hash = hashPCHText("\n", 1, running_hash);
+			if (name[0] != '<' && seen_names.insert(name).second) {
+				seen.push_back(make_pair(name, (uint64_t)(line - text)));
+			}
+		}
+	}
+
+	if (!length) {
+		return false;
+	}
+
+	for (seen_it = seen.begin(); seen_it != seen.end(); seen_it++) {
+		if (seen_it->second < length) {
+			header_hash = 0;
+			hashFile(seen_it->first, header_hash);
+			headers.push_back(make_pair(seen_it->first, header_hash));
+		}
+	}
+
+	return true;
+}
+
+static bool
+writeType(ostream& strm, Type *type, set<StructType *>& named_structs)
+{
+	unsigned i;
+
+	switch (type->getTypeID()) {
+		case Type::VoidTyID:
+			strm << " void";
+			break;
+		case Type::FloatTyID:
+			strm << " float";
+			break;
+		case Type::DoubleTyID:
+			strm << " double";
+			break;
+		case Type::X86_FP80TyID:
+			strm << " fp80";
+			break;
+		case Type::FP128TyID:
+			strm << " fp128";
+			break;
+		case Type::IntegerTyID:
+			strm << " i" << type->getIntegerBitWidth();
+			break;
+		case Type::PointerTyID:
+			strm << " *";
+			return writeType(strm, type->getPointerElementType(), named_structs);
+		case Type::ArrayTyID:
+			strm << " [ " << type->getArrayNumElements();
+			return writeType(strm, type->getArrayElementType(), named_structs);
+		case Type::VectorTyID:
+			strm << " < " << type->getVectorNumElements();
+			return writeType(strm, type->getVectorElementType(), named_structs);
+		case Type::FunctionTyID:
+		{
+			FunctionType *ftype = dyn_cast<FunctionType>(type);
+
+			strm << " fn " << ftype->getNumParams() << " " << ftype->isVarArg();
+			if (!writeType(strm, ftype->getReturnType(), named_structs)) {
+				return false;
+			}
+			for (i = 0; i < ftype->getNumParams(); i++) {
+				if (!writeType(strm, ftype->getParamType(i), named_structs)) {
+					return false;
+				}
+			}
+			break;
+		}
+		case Type::StructTyID:
+		{
+			StructType *stype = dyn_cast<StructType>(type);
+
+			if (stype->hasName()) {
+				strm << " %" << stype->getName().str();
+				named_structs.insert(stype);
+				break;
+			}
+
+			strm << " { " << stype->isPacked() << " " << stype->getNumElements();
+			for (i = 0; i < stype->getNumElements(); i++) {
+				if (!writeType(strm, stype->getElementType(i), named_structs)) {
+					return false;
+				}
+			}
+			break;
+		}
+		default:
+			return false;
+	}
+
+	return true;
+}
+
+// written as <count> (<index> <kind>)...; only enum attributes are ever set on declarations
+static void
+writeAttributes(ostream& strm, const AttributeSet& attrs)
+{
+	AttributeSet::iterator attr_it;
+	vector<pair<unsigned, unsigned> > kinds;
+	unsigned i;
+
+	for (i = 0; i < attrs.getNumSlots(); i++) {
+		for (attr_it = attrs.begin(i); attr_it != attrs.end(i); attr_it++) {
+			if (attr_it->isEnumAttribute()) {
+				kinds.push_back(make_pair(attrs.getSlotIndex(i), (unsigned)attr_it->getKindAsEnum()));
+			}
+		}
+	}
+
+	strm << " " << kinds.size();
+	for (i = 0; i < kinds.size(); i++) {
+		strm << " " << kinds[i].first << " " << kinds[i].second;
+	}
+
+	return;
+}
+
+bool
+PrecompiledHeader::emit(CodeGenContext& context, const PCHPrefix& prefix, const string& path)
+{
+	ostringstream body;
+	set<StructType *> named_structs;
+	set<StructType *> written_structs;
+	set<StructType *>::const_iterator struct_it;
+	StructType *stype;
+	std::map<std::string, int>::const_iterator typedef_it;
+	TypeInfoTable::const_iterator type_it;
+	std::map<std::string, FieldMap>::const_iterator struct_field_it;
+	std::map<std::string, UnionFieldMap>::const_iterator union_field_it;
+	FieldMap::const_iterator field_it;
+	UnionFieldMap::const_iterator ufield_it;
+	std::map<std::string, LazyDecl>::const_iterator lazy_it;
+	vector<pair<string, uint64_t> >::const_iterator header_it;
+	Module::iterator func_it;
+	Module::global_iterator global_it;
+	unsigned i;
+	bool ok = true;
+
+	// only declarations can be restored without replaying code
+	for (func_it = context.module->begin(); func_it != context.module->end(); func_it++) {
+		if (!func_it->isDeclaration()) {
+			ErrorMessage::tmpError("Cannot precompile headers defining function " + func_it->getName().str());
+			return false;
+		}
+	}
+	for (global_it = context.module->global_begin(); global_it != context.module->global_end(); global_it++) {
+		if (global_it->hasInitializer()) {
+			ErrorMessage::tmpError("Cannot precompile headers defining variable " + global_it->getName().str());
+			return false;
+		}
+	}
+
+	for (typedef_it = type_def.begin(); typedef_it != type_def.end(); typedef_it++) {
+		body << "typedef " << typedef_it->first << "\n";
+	}
+
+	for (type_it = context.types.begin(); type_it != context.types.end(); type_it++) {
+		body << "type " << type_it->first;
+		ok = ok && writeType(body, type_it->second, named_structs);
+		body << "\n";
+	}
+
+	for (struct_field_it = context.structs.begin();
+		 struct_field_it != context.structs.end(); struct_field_it++) {
+		body << "fields " << struct_field_it->first << " " << struct_field_it->second.size();
+		for (field_it = struct_field_it->second.begin();
+			 field_it != struct_field_it->second.end(); field_it++) {
+			body << " " << field_it->first << " " << field_it->second;
+		}
+		body << "\n";
+	}
+
+	for (union_field_it = context.unions.begin();
+		 union_field_it != context.unions.end(); union_field_it++) {
+		body << "ufields " << union_field_it->first << " " << union_field_it->second.size();
+		for (ufield_it = union_field_it->second.begin();
+			 ufield_it != union_field_it->second.end(); ufield_it++) {
+			body << " " << ufield_it->first;
+			ok = ok && writeType(body, ufield_it->second, named_structs);
+		}
+		body << "\n";
+	}
+
+	// prototypes and extern globals come back as lazy declarations
+	for (lazy_it = context.getLazyDecls().begin();
+		 lazy_it != context.getLazyDecls().end(); lazy_it++) {
+		body << "decl " << lazy_it->first << " " << lazy_it->second.linkage;
+		ok = ok && writeType(body, lazy_it->second.type, named_structs);
+		writeAttributes(body, lazy_it->second.attributes);
+		body << "\n";
+	}
+	for (func_it = context.module->begin(); func_it != context.module->end(); func_it++) {
+		body << "decl " << func_it->getName().str() << " " << func_it->getLinkage();
+		ok = ok && writeType(body, func_it->getFunctionType(), named_structs);
+		writeAttributes(body, func_it->getAttributes());
+		body << "\n";
+	}
+	for (global_it = context.module->global_begin(); global_it != context.module->global_end(); global_it++) {
+		body << "decl " << global_it->getName().str() << " " << global_it->getLinkage();
+		ok = ok && writeType(body, global_it->getType()->getElementType(), named_structs);
+		writeAttributes(body, AttributeSet());
+		body << "\n";
+	}
+
+	// struct bodies may name further structs
+	while (written_structs.size() != named_structs.size()) {
+		for (struct_it = named_structs.begin(); struct_it != named_structs.end(); struct_it++) {
+			if (written_structs.insert(*struct_it).second) {
+				break;
+			}
+		}
+		stype = *struct_it;
+
+		body << "struct " << stype->getName().str();
+		if (stype->isOpaque()) {
+			body << " opaque";
+		} else {
+			body << " " << stype->isPacked() << " " << stype->getNumElements();
+			for (i = 0; i < stype->getNumElements(); i++) {
+				ok = ok && writeType(body, stype->getElementType(i), named_structs);
+			}
+		}
+		body << "\n";
+	}
+
+	if (!ok) {
+		ErrorMessage::tmpError("Cannot precompile headers: unsupported type");
+		return false;
+	}
+
+	ofstream pch_file(path.c_str(), ios::out | ios::binary);
+	if (!pch_file) {
+		ErrorMessage::tmpError("Cannot open precompiled header file: " + path);
+		return false;
+	}
+
+	pch_file << PCH_MAGIC << " " << PCH_VERSION << "\n";
+	pch_file << "includes " << prefix.includes_hash << "\n";
+	for (header_it = prefix.headers.begin(); header_it != prefix.headers.end(); header_it++) {
+		pch_file << "header " << header_it->second << " "
+				 << header_it->first.length() << " " << header_it->first << "\n";
+	}
+	pch_file << body.str();
+	pch_file << "end\n";
+
+	return true;
+}
+
+class PCHReader {
+	const char *cur;
+	const char *end;
+	std::map<string, StructType *> named_structs;
+
+	void
+	skipSpace()
+	{
+		for (; cur < end && isspace(*cur); cur++);
+		return;
+	}
+
+public:
+	PCHReader(const char *begin, const char *end) :
+	cur(begin), end(end) { }
+
+	string
+	readToken()
+	{
+		const char *begin;
+
+		skipSpace();
+		for (begin = cur; cur < end && !isspace(*cur); cur++);
+
+		return string(begin, cur);
+	}
+
+	uint64_t
+	readInt()
+	{
+		return strtoull(readToken().c_str(), NULL, 10);
+	}
+
+	string
+	readChars(uint64_t length)
+	{
+		string ret;
+
+		skipSpace();
+		if (length > (uint64_t)(end - cur)) {
+			length = end - cur;
+		}
+		ret = string(cur, length);
+		cur += length;
+
+		return ret;
+	}
+
+	AttributeSet
+	readAttributes()
+	{
+		AttributeSet ret;
+		uint64_t i, count;
+		unsigned index;
+
+		for (i = 0, count = readInt(); i < count; i++) {
+			index = readInt();
+			ret = ret.addAttribute(getGlobalContext(), index, (Attribute::AttrKind)readInt());
+		}
+
+		return ret;
+	}
+
+	StructType *
+	getNamedStruct(const string& name)
+	{
+		if (named_structs.find(name) == named_structs.end()) {
+			named_structs[name] = StructType::create(getGlobalContext(), name);
+		}
+		return named_structs[name];
+	}
+
+	Type *
+	readType()
+	{
+		string token = readToken();
+		vector<Type *> elements;
+		Type *tmp_type;
+		uint64_t i, count;
+		bool flag;
+
+		if (token == "void") {
+			return Type::getVoidTy(getGlobalContext());
+		} else if (token == "float") {
+			return Type::getFloatTy(getGlobalContext());
+		} else if (token == "double") {
+			return Type::getDoubleTy(getGlobalContext());
+		} else if (token == "fp80") {
+			return Type::getX86_FP80Ty(getGlobalContext());
+		} else if (token == "fp128") {
+			return Type::getFP128Ty(getGlobalContext());
+		} else if (token[0] == 'i') {
+			return IntegerType::get(getGlobalContext(), atoi(token.c_str() + 1));
+		} else if (token == "*") {
+			return (tmp_type = readType()) ? tmp_type->getPointerTo() : NULL;
+		} else if (token == "[") {
+			count = readInt();
+			return (tmp_type = readType()) ? ArrayType::get(tmp_type, count) : NULL;
+		} else if (token == "<") {
+			count = readInt();
+			return (tmp_type = readType()) ? VectorType::get(tmp_type, count) : NULL;
+		} else if (token == "fn") {
+			count = readInt();
+			flag = readInt();
+			if (!(tmp_type = readType())) {
+				return NULL;
+			}
+			for (i = 0; i < count; i++) {
+				elements.push_back(readType());
+				if (!elements.back()) {
+					return NULL;
+				}
+			}
+			return FunctionType::get(tmp_type, makeArrayRef(elements), flag);
+		} else if (token == "{") {
+			flag = readInt();
+			count = readInt();
+			for (i = 0; i < count; i++) {
+				elements.push_back(readType());
+				if (!elements.back()) {
+					return NULL;
+				}
+			}
+			return StructType::get(getGlobalContext(), makeArrayRef(elements), flag);
+		} else if (token[0] == '%') {
+			return getNamedStruct(token.substr(1));
+		}
+
+		return NULL;
+	}
+};
+
+bool
+PrecompiledHeader::load(CodeGenContext& context, const PCHPrefix& prefix, const string& path)
+{
+	ErrorOr<std::unique_ptr<MemoryBuffer> > buffer = MemoryBuffer::getFile(path);
+	vector<pair<string, uint64_t> >::const_iterator header_it;
+	string record, name, field;
+	uint64_t includes_hash;
+	uint64_t i, count, hash;
+	Type *tmp_type;
+	vector<Type *> elements;
+	bool packed;
+	bool corrupted = false;
+
+	if (!buffer) {
+		ErrorMessage::tmpNote("Cannot read precompiled header " + path + ", ignored");
+		return false;
+	}
+
+	// mapped by MemoryBuffer; every record is read once in place
+	PCHReader reader((*buffer)->getBufferStart(), (*buffer)->getBufferEnd());
+
+	if (reader.readToken() != PCH_MAGIC || reader.readInt() != PCH_VERSION) {
+		ErrorMessage::tmpNote("Invalid precompiled header " + path + ", ignored");
+		return false;
+	}
+
+	if (reader.readToken() != "includes") {
+		ErrorMessage::tmpNote("Invalid precompiled header " + path + ", ignored");
+		return false;
+	}
+	includes_hash = reader.readInt();
+
+	while ((record = reader.readToken()) == "header") {
+		hash = reader.readInt();
+		name = reader.readChars(reader.readInt());
+		for (header_it = prefix.headers.begin(); header_it != prefix.headers.end(); header_it++) {
+			if (header_it->first == name) {
+				break;
+			}
+		}
+		if (header_it == prefix.headers.end() || header_it->second != hash) {
+			ErrorMessage::tmpNote("Precompiled header " + path + " is out of date ("
+								  + name + " changed), ignored");
+			return false;
+		}
+	}
+
+	if (includes_hash != prefix.includes_hash) {
+		ErrorMessage::tmpNote("Precompiled header " + path
+							  + " was built from different includes, ignored");
+		return false;
+	}
+
+	for (; record != "end" && !corrupted; record = reader.readToken()) {
+		name = reader.readToken();
+
+		if (record == "typedef") {
+			type_def[name] = 0;
+		} else if (record == "type") {
+			if (!(tmp_type = reader.readType())) {
+				corrupted = true;
+				break;
+			}
+			context.types[name] = tmp_type;
+		} else if (record == "fields") {
+			FieldMap& field_map = context.structs[name];
+			for (i = 0, count = reader.readInt(); i < count; i++) {
+				field = reader.readToken();
+				field_map[field] = reader.readInt();
+			}
+		} else if (record == "ufields") {
+			UnionFieldMap& field_map = context.unions[name];
+			for (i = 0, count = reader.readInt(); i < count; i++) {
+				field = reader.readToken();
+				if (!(field_map[field] = reader.readType())) {
+					corrupted = true;
+					break;
+				}
+			}
+		} else if (record == "decl") {
+			count = reader.readInt();
+			if (!(tmp_type = reader.readType())) {
+				corrupted = true;
+				break;
+			}
+			context.addLazyDecl(name, tmp_type, (GlobalValue::LinkageTypes)count, reader.readAttributes());
+		} else if (record == "struct") {
+			field = reader.readToken();
+			if (field == "opaque") {
+				reader.getNamedStruct(name);
+				continue;
+			}
+
+			packed = atoi(field.c_str());
+			elements.clear();
+			for (i = 0, count = reader.readInt(); i < count; i++) {
+				elements.push_back(reader.readType());
+				if (!elements.back()) {
+					corrupted = true;
+					break;
+				}
+			}
+			if (!corrupted) {
+				reader.getNamedStruct(name)->setBody(makeArrayRef(elements), packed);
+			}
+		} else {
+			corrupted = true;
+		}
+	}
+
+	if (corrupted || record != "end") {
+		ErrorMessage::tmpError("Corrupted precompiled header " + path);
+		exit(1);
+	}
+
+	return true;
+}
@@ -0,0 +1,38 @@
+#ifndef _CGPCH_H_
+#define _CGPCH_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+#include "CGAST.h"
+
+#define PCH_MAGIC ("PHI-PCH")
+#define PCH_VERSION 3
+
+using namespace std;
+
+uint64_t hashPCHText(const char *text, size_t length, uint64_t hash = 14695981039346656037ULL); // FNV-1a
+
+// the part of a preprocessed file that comes from its #include lines:
+// everything before the last line marker returning to the main file
+class PCHPrefix {
+public:
+	string main_file;
+	uint64_t length = 0;
+	uint64_t includes_hash = 0; // include order and main file code, without line numbers
+	vector<pair<string, uint64_t> > headers; // path, content hash
+
+	bool scan(const string& preprocessed_path);
+};
+
+class PrecompiledHeader {
+public:
+	// serialize type_def, types/structs/unions and global declarations of context
+	static bool emit(CodeGenContext& context, const PCHPrefix& prefix, const string& path);
+
+	// load a state written by emit if it was built from the same prefix
+	static bool load(CodeGenContext& context, const PCHPrefix& prefix, const string& path);
+};
+
+#endif
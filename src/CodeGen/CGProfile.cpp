@@ -0,0 +1,434 @@
+#include "AST/Node.h"
+#include "CGAST.h"
+#include "CGErr.h"
+#include <fstream>
+#include <ctype.h>
+#include <stdlib.h>
+#include <llvm/IR/MDBuilder.h>
+
+/*
+ * Two stage profile guided optimization.
+ *
+ * -fprofile-generate gives every function a range of 64-bit counters:
+ *   entry:         1 slot, times the function was entered
+ *   branch:        2 slots, times it was reached and times it was taken
+ *   indirect call: 3 slots, times it was reached, then the callee which
+ *                  won a majority vote (Boyer-Moore) and its votes
+ * and appends them at exit as text:
+ *   function <name> <slots>
+ *    <count or callee name> ...
+ * where the name of a static function is <source file>:<name>.
+ *
+ * -fprofile-use reads the dump back, summing the records every object file
+ * and every run appended for a function. Slots are handed out in codegen order,
+ * so the same source reaches the same slots; the counts become branch
+ * weights, hot/cold function attributes and promoted indirect calls.
+ */
+
+#define PROFILE_COUNTERS_NAME ("__phi_prof_counters")
+#define PROFILE_DUMP_NAME ("__phi_prof_dump")
+
+// two majority votes merge like one vote over both runs
+static void
+mergeVotes(FunctionProfile& profile, unsigned slot, const std::string& target, uint64_t votes)
+{
+	std::string& merged_target = profile.targets[slot];
+	uint64_t& merged_votes = profile.counts[slot + 1];
+
+	if (merged_target == target) {
+		merged_votes += votes;
+	} else if (votes > merged_votes) {
+		merged_target = target;
+		merged_votes = votes - merged_votes;
+	} else {
+		merged_votes -= votes;
+	}
+
+	if (merged_target.empty()) {
+		profile.targets.erase(slot);
+	}
+
+	return;
+}
+
+bool
+CodeGenContext::loadProfile(const std::string& file_name)
+{
+	std::ifstream in(file_name.c_str());
+	std::map<std::string, FunctionProfile>::const_iterator profile_it;
+	FunctionProfile record;
+	std::string word;
+	std::string name;
+	unsigned size;
+	unsigned i;
+
+	if (!in) {
+		return false;
+	}
+
+	while (in >> word) {
+		if (word != "function" || !(in >> name >> size)) {
+			return false;
+		}
+
+		record.counts.assign(size, 0);
+		record.targets.clear();
+		for (i = 0; i < size && in >> word; i++) {
+			if (isdigit(word[0])) {
+				record.counts[i] = strtoull(word.c_str(), NULL, 10);
+			} else if (word != "-") {
+				record.targets[i] = word;
+			}
+		}
+
+		FunctionProfile& profile = profile_data[name];
+		if (profile.counts.size() != size) { // first record, or the function changed since
+			profile = record;
+			continue;
+		}
+
+		for (i = 0; i < size; i++) {
+			if ((record.targets.count(i) || profile.targets.count(i)) && i + 1 < size) {
+				mergeVotes(profile, i, record.targets[i], record.counts[i + 1]);
+				i++; // votes slot
+			} else {
+				profile.counts[i] += record.counts[i];
+			}
+		}
+	}
+
+	for (profile_it = profile_data.begin(); profile_it != profile_data.end(); profile_it++) {
+		if (!profile_it->second.counts.empty() && profile_it->second.counts[0] > profile_max_entry) {
+			profile_max_entry = profile_it->second.counts[0];
+		}
+	}
+
+	return true;
+}
+
+static Value *
+getCounter(CodeGenContext& context, unsigned slot)
+{
+	if (!context.profile_counters) { // sized by finalizeProfile
+		context.profile_counters = new GlobalVariable(*context.module, context.builder->getInt64Ty(), false,
+													  GlobalValue::PrivateLinkage, context.builder->getInt64(0),
+													  PROFILE_COUNTERS_NAME);
+	}
+
+	return context.builder->CreateConstGEP1_64(context.profile_counters,
+											   context.profiled_functions.back().first + slot);
+}
+
+static void
+incrementCounter(CodeGenContext& context, unsigned slot, Value *step)
+{
+	Value *counter = getCounter(context, slot);
+
+	context.builder->CreateStore(context.builder->CreateAdd(context.builder->CreateLoad(counter), step),
+								 counter);
+
+	return;
+}
+
+// static functions of different files may share a name but not a profile
+static std::string
+getProfileName(CodeGenContext& context, Function *function)
+{
+	if (function->hasLocalLinkage()) {
+		return context.profile_unit + ":" + function->getName().str();
+	}
+
+	return function->getName().str();
+}
+
+void
+CodeGenContext::beginFunctionProfile(Function *function)
+{
+	std::map<std::string, FunctionProfile>::iterator profile_it;
+	ProfiledFunction record;
+	uint64_t entry;
+
+	if (profile_output.empty() && profile_data.empty()) {
+		return;
+	}
+
+	profiling = true;
+	profile_slot = 1;
+
+	if (!profile_output.empty()) {
+		record.name = getProfileName(*this, function);
+		record.first = profiled_functions.empty() ? 0
+												  : profiled_functions.back().first + profiled_functions.back().size;
+		record.size = 0;
+		profiled_functions.push_back(record);
+		incrementCounter(*this, 0, builder->getInt64(1));
+	}
+
+	if ((profile_it = profile_data.find(getProfileName(*this, function))) != profile_data.end()) {
+		current_profile = &profile_it->second;
+		entry = current_profile->counts.empty() ? 0 : current_profile->counts[0];
+		if (!entry) {
+			function->addFnAttr(Attribute::Cold);
+		} else if (entry * 10 >= profile_max_entry) {
+			function->addFnAttr(Attribute::InlineHint);
+		}
+	}
+
+	return;
+}
+
+void
+CodeGenContext::endFunctionProfile(Function *function, int lineno, char *file_name)
+{
+	Function::iterator block_it;
+	BasicBlock::iterator inst_it;
+
+	if (!profiling) {
+		return;
+	}
+
+	if (!profile_output.empty()) {
+		profiled_functions.back().size = profile_slot;
+	}
+
+	// the source changed since the profile was taken
+	if (current_profile && current_profile->counts.size() != profile_slot) {
+		CGERR_Profile_Mismatch(*this, function->getName().str().c_str());
+		CGERR_setLineNum(*this, lineno, file_name);
+		CGERR_showAllMsg(*this);
+
+		function->removeFnAttr(Attribute::Cold);
+		function->removeFnAttr(Attribute::InlineHint);
+		for (block_it = function->begin(); block_it != function->end(); block_it++) {
+			for (inst_it = block_it->begin(); inst_it != block_it->end(); inst_it++) {
+				inst_it->setMetadata(LLVMContext::MD_prof, NULL);
+			}
+		}
+	}
+
+	profiling = false;
+	current_profile = NULL;
+
+	return;
+}
+
+unsigned
+CodeGenContext::countBranch(Value *cond)
+{
+	unsigned slot = profile_slot;
+
+	if (!profiling) {
+		return PROFILE_NO_SLOT;
+	}
+
+	profile_slot += 2;
+	if (!profile_output.empty()) {
+		incrementCounter(*this, slot, builder->getInt64(1));
+		incrementCounter(*this, slot + 1, builder->CreateZExt(cond, builder->getInt64Ty()));
+	}
+
+	return slot;
+}
+
+// branch weights are 32-bit
+static MDNode *
+createWeights(uint64_t taken, uint64_t not_taken)
+{
+	uint64_t scale = std::max(taken, not_taken) / UINT32_MAX + 1;
+
+	return MDBuilder(getGlobalContext()).createBranchWeights(taken / scale + 1, not_taken / scale + 1);
+}
+
+// weights given to likely() and unlikely(), as LowerExpectIntrinsic does
+#define LIKELY_BRANCH_WEIGHT 64
+#define UNLIKELY_BRANCH_WEIGHT 4
+
+void
+CodeGenContext::setBranchWeights(Instruction *br, unsigned slot, int hint)
+{
+	uint64_t reached;
+	uint64_t taken;
+
+	// what was measured wins over what the source expects
+	if (slot != PROFILE_NO_SLOT && current_profile
+		&& slot + 1 < current_profile->counts.size()) {
+		reached = current_profile->counts[slot];
+		taken = current_profile->counts[slot + 1];
+		if (taken <= reached) {
+			br->setMetadata(LLVMContext::MD_prof, createWeights(taken, reached - taken));
+			return;
+		}
+	}
+
+	if (hint) {
+		br->setMetadata(LLVMContext::MD_prof, MDBuilder(getGlobalContext()).createBranchWeights(
+							hint > 0 ? LIKELY_BRANCH_WEIGHT : UNLIKELY_BRANCH_WEIGHT,
+							hint > 0 ? UNLIKELY_BRANCH_WEIGHT : LIKELY_BRANCH_WEIGHT));
+	}
+
+	return;
+}
+
+unsigned
+CodeGenContext::countIndirectCall(Value *callee)
+{
+	unsigned slot = profile_slot;
+	Value *target;
+	Value *cand_ptr;
+	Value *votes_ptr;
+	Value *cand;
+	Value *votes;
+	Value *same;
+	Value *empty;
+
+	if (!profiling) {
+		return PROFILE_NO_SLOT;
+	}
+
+	profile_slot += 3;
+	if (!profile_output.empty()) {
+		incrementCounter(*this, slot, builder->getInt64(1));
+
+		target = builder->CreatePtrToInt(callee, builder->getInt64Ty());
+		cand_ptr = getCounter(*this, slot + 1);
+		votes_ptr = getCounter(*this, slot + 2);
+		cand = builder->CreateLoad(cand_ptr);
+		votes = builder->CreateLoad(votes_ptr);
+		same = builder->CreateICmpEQ(cand, target);
+		empty = builder->CreateICmpEQ(votes, builder->getInt64(0));
+
+		builder->CreateStore(builder->CreateSelect(empty, target, cand), cand_ptr);
+		builder->CreateStore(builder->CreateSelect(same, builder->CreateAdd(votes, builder->getInt64(1)),
+												   builder->CreateSelect(empty, builder->getInt64(1),
+																		 builder->CreateSub(votes, builder->getInt64(1)))),
+							 votes_ptr);
+		profiled_functions.back().target_slots.insert(slot + 1);
+	}
+
+	return slot;
+}
+
+Function *
+CodeGenContext::getHotTarget(unsigned slot, FunctionType *ftype, MDNode **weights)
+{
+	std::map<unsigned, std::string>::iterator target_it;
+	Function *target;
+	uint64_t reached;
+	uint64_t votes;
+
+	if (slot == PROFILE_NO_SLOT || !current_profile
+		|| slot + 2 >= current_profile->counts.size()
+		|| (target_it = current_profile->targets.find(slot + 1)) == current_profile->targets.end()) {
+		return NULL;
+	}
+
+	reached = current_profile->counts[slot];
+	votes = current_profile->counts[slot + 2];
+
+	// the survivor of the vote is only worth a guard if it kept a good share
+	if (!reached || votes * 4 < reached
+		|| !(target = module->getFunction(target_it->second))
+		|| target->getFunctionType() != ftype) {
+		return NULL;
+	}
+
+	*weights = createWeights(votes, reached - votes);
+
+	return target;
+}
+
+void
+CodeGenContext::finalizeProfile()
+{
+	std::vector<ProfiledFunction>::const_iterator func_it;
+	std::vector<Function *> targets;
+	Module::iterator target_it;
+	std::vector<Function *>::const_iterator cand_it;
+	Type *int8_ptr_type = builder->getInt8PtrTy();
+	GlobalVariable *counters;
+	Function *dump;
+	Constant *fopen_func;
+	Constant *fprintf_func;
+	Constant *fclose_func;
+	BasicBlock *open_block;
+	BasicBlock *write_block;
+	BasicBlock *end_block;
+	Value *fp;
+	Value *val;
+	Value *name;
+	unsigned size;
+	unsigned i;
+
+	if (profile_output.empty()) {
+		return;
+	}
+
+	size = profiled_functions.empty() ? 0 : profiled_functions.back().first + profiled_functions.back().size;
+	counters = new GlobalVariable(*module, ArrayType::get(builder->getInt64Ty(), size), false,
+								  GlobalValue::PrivateLinkage,
+								  ConstantAggregateZero::get(ArrayType::get(builder->getInt64Ty(), size)), "");
+	if (profile_counters) {
+		profile_counters->replaceAllUsesWith(ConstantExpr::getBitCast(counters, profile_counters->getType()));
+		profile_counters->eraseFromParent();
+	}
+	counters->setName(PROFILE_COUNTERS_NAME);
+	profile_counters = NULL;
+
+	// possible callees of the indirect calls
+	for (target_it = module->begin(); target_it != module->end(); target_it++) {
+		if (target_it->hasAddressTaken()) {
+			targets.push_back(&*target_it);
+		}
+	}
+
+	fopen_func = module->getOrInsertFunction("fopen", FunctionType::get(int8_ptr_type,
+												std::vector<Type *>(2, int8_ptr_type), false));
+	fprintf_func = module->getOrInsertFunction("fprintf", FunctionType::get(builder->getInt32Ty(),
+												std::vector<Type *>(2, int8_ptr_type), true));
+	fclose_func = module->getOrInsertFunction("fclose", FunctionType::get(builder->getInt32Ty(),
+												int8_ptr_type, false));
+
+	dump = Function::Create(FunctionType::get(builder->getVoidTy(), false), GlobalValue::InternalLinkage,
+							PROFILE_DUMP_NAME, module);
+	open_block = BasicBlock::Create(getGlobalContext(), "", dump);
+	write_block = BasicBlock::Create(getGlobalContext(), "", dump);
+	end_block = BasicBlock::Create(getGlobalContext(), "", dump);
+
+	builder->SetInsertPoint(open_block);
+	// appended, so each object file and each run adds its own records
+	fp = builder->CreateCall2(fopen_func, builder->CreateGlobalStringPtr(profile_output),
+							  builder->CreateGlobalStringPtr("a"));
+	builder->CreateCondBr(builder->CreateIsNull(fp), end_block, write_block);
+
+	builder->SetInsertPoint(write_block);
+	for (func_it = profiled_functions.begin(); func_it != profiled_functions.end(); func_it++) {
+		builder->CreateCall3(fprintf_func, fp, builder->CreateGlobalStringPtr("function %s %u\n"),
+							 builder->CreateGlobalStringPtr(func_it->name), builder->getInt32(func_it->size));
+		for (i = 0; i < func_it->size; i++) {
+			val = builder->CreateLoad(builder->CreateConstGEP2_64(counters, 0, func_it->first + i));
+			if (!func_it->target_slots.count(i)) {
+				builder->CreateCall3(fprintf_func, fp, builder->CreateGlobalStringPtr(" %llu"), val);
+				continue;
+			}
+
+			// callees are written by name, they are only addresses in this run
+			name = builder->CreateGlobalStringPtr("-");
+			for (cand_it = targets.begin(); cand_it != targets.end(); cand_it++) {
+				name = builder->CreateSelect(builder->CreateICmpEQ(val, builder->CreatePtrToInt(*cand_it,
+																								builder->getInt64Ty())),
+											 builder->CreateGlobalStringPtr((*cand_it)->getName()), name);
+			}
+			builder->CreateCall3(fprintf_func, fp, builder->CreateGlobalStringPtr(" %s"), name);
+		}
+		builder->CreateCall2(fprintf_func, fp, builder->CreateGlobalStringPtr("\n"));
+	}
+	builder->CreateCall(fclose_func, fp);
+	builder->CreateBr(end_block);
+
+	builder->SetInsertPoint(end_block);
+	builder->CreateRetVoid();
+
+	appendToGlobalDtors(*module, dump, 65535);
+
+	return;
+}
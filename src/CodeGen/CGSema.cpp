@@ -0,0 +1,342 @@
+#include "AST/Node.h"
+#include "CGAST.h"
+#include "CGErr.h"
+#include "Grammar/Parser.hpp"
+#include "Inlines.h"
+
+/*
+ * Expression types resolved without emitting any instruction.
+ * They follow the conversions done by the codeGen of each node
+ * so that typeof, sizeof and the conditional expression can know
+ * the type of an operand before (or without) lowering it.
+ */
+
+Type *
+NExpression::getExprType(CodeGenContext& context)
+{
+	if (!expr_type) {
+		expr_type = resolveType(context);
+	}
+
+	return expr_type;
+}
+
+// fallback for expressions we can't type statically:
+// lower into a detached function which is freed right after
+Type *
+NExpression::resolveType(CodeGenContext& context)
+{
+	IRBuilderBase::InsertPoint backup = context.builder->saveIP();
+	bool is_lval = context.isLValue();
+	Function *scratch;
+	Value *tmp_val;
+	Type *ret;
+
+	scratch = Function::Create(FunctionType::get(context.builder->getVoidTy(), false),
+							   GlobalValue::InternalLinkage);
+	context.builder->SetInsertPoint(BasicBlock::Create(getGlobalContext(), "", scratch));
+
+	context.resetLValue();
+	tmp_val = codeGen(context);
+	if (is_lval) context.setLValue();
+
+	ret = tmp_val ? tmp_val->getType() : NULL;
+
+	context.builder->restoreIP(backup);
+	scratch->dropAllReferences();
+	delete scratch;
+
+	return ret;
+}
+
+static Type *
+getCommonType(Type *ltype, Type *rtype)
+{
+	if (isSameType(ltype, rtype)) {
+		return ltype;
+	}
+
+	if (ltype->isIntegerTy() && rtype->isIntegerTy()) {
+		return ltype->getIntegerBitWidth() > rtype->getIntegerBitWidth() ? ltype : rtype;
+	} else if (ltype->isFloatingPointTy() && rtype->isFloatingPointTy()) {
+		return ltype->getTypeID() > rtype->getTypeID() ? ltype : rtype;
+	} else if (ltype->isIntegerTy() && rtype->isFloatingPointTy()) {
+		return rtype;
+	} else if (ltype->isFloatingPointTy() && rtype->isIntegerTy()) {
+		return ltype;
+	}
+
+	return NULL;
+}
+
+Type *
+NCompoundExpr::resolveType(CodeGenContext& context)
+{
+	return first.getExprType(context);
+}
+
+Type *
+NIdentifier::resolveType(CodeGenContext& context)
+{
+	std::map<std::string, LazyDecl>::iterator lazy_it;
+	Type *lazy_func_type = NULL;
+	Function *func;
+
+	if (context.currentBlock()
+		&& context.getTopLocals().find(name) != context.getTopLocals().end()) {
+		return context.getTopLocals()[name]->getType()->getPointerElementType();
+	}
+
+	// lazy globals become the first globals found by codeGen
+	if ((lazy_it = context.getLazyDecls().find(context.formatName(name))) != context.getLazyDecls().end()
+		|| (lazy_it = context.getLazyDecls().find(name)) != context.getLazyDecls().end()) {
+		if (!isFunctionType(lazy_it->second.type)) {
+			return lazy_it->second.type;
+		}
+		lazy_func_type = lazy_it->second.type->getPointerTo();
+	}
+
+	if (context.getGlobals().find(context.formatName(name)) != context.getGlobals().end()) {
+		return context.getGlobals()[context.formatName(name)]->getType()->getPointerElementType();
+	}
+
+	if (context.getGlobals().find(name) != context.getGlobals().end()) {
+		return context.getGlobals()[name]->getType()->getPointerElementType();
+	}
+
+	if (lazy_func_type) {
+		return lazy_func_type;
+	}
+
+	if ((func = context.module->getFunction(context.formatName(name)))
+		|| (func = context.module->getFunction(name))) {
+		return func->getType();
+	}
+
+	return NExpression::resolveType(context); // reports the undeclared identifier
+}
+
+Type *
+NInteger::resolveType(CodeGenContext& context)
+{
+	Value *val = codeGen(context); // constant, no instruction
+
+	return val->getType();
+}
+
+Type *
+NChar::resolveType(CodeGenContext& context)
+{
+	return context.builder->getInt8Ty();
+}
+
+Type *
+NBoolean::resolveType(CodeGenContext& context)
+{
+	return context.builder->getInt1Ty();
+}
+
+Type *
+NDouble::resolveType(CodeGenContext& context)
+{
+	return context.builder->getDoubleTy();
+}
+
+Type *
+NString::resolveType(CodeGenContext& context)
+{
+	Type *str_type = ArrayType::get(context.builder->getInt8Ty(), strlen(value.c_str()) + 1);
+
+	// string literals in functions are private globals
+	return context.currentBlock() ? str_type->getPointerTo() : str_type;
+}
+
+Type *
+NMethodCall::resolveType(CodeGenContext& context)
+{
+	Type *func_type = func_expr.getExprType(context);
+
+	if (func_type && func_type->isPointerTy()
+		&& func_type->getPointerElementType()->isFunctionTy()) {
+		return dyn_cast<FunctionType>(func_type->getPointerElementType())->getReturnType();
+	}
+
+	return NExpression::resolveType(context);
+}
+
+Type *
+NFieldExpr::resolveType(CodeGenContext& context)
+{
+	Type *operand_type = operand.getExprType(context);
+	const RecordLayout *layout;
+	const FieldLayout *field;
+
+	if (operand_type && operand_type->isStructTy()
+		&& (layout = context.getLayout(dyn_cast<StructType>(operand_type)))
+		&& (field = layout->getField(field_name.name))) {
+		return field->type;
+	}
+
+	return NExpression::resolveType(context); // reports the error
+}
+
+Type *
+NArrayExpr::resolveType(CodeGenContext& context)
+{
+	Type *operand_type = operand.getExprType(context);
+
+	if (operand_type && operand_type->isArrayTy()) {
+		return operand_type->getArrayElementType();
+	} else if (operand_type && operand_type->isPointerTy()) {
+		return operand_type->getPointerElementType();
+	}
+
+	return NExpression::resolveType(context);
+}
+
+Type *
+NCondExpr::resolveType(CodeGenContext& context)
+{
+	Type *ltype = if_true.getExprType(context);
+	Type *rtype = if_else.getExprType(context);
+	Type *common_type;
+
+	if (!ltype || !rtype) {
+		return NExpression::resolveType(context);
+	}
+
+	common_type = getCommonType(ltype, rtype);
+
+	return common_type ? common_type : ltype; // else branch is bitcast to the true one
+}
+
+Type *
+NBinaryExpr::resolveType(CodeGenContext& context)
+{
+	Type *ltype;
+	Type *rtype;
+	Type *common_type;
+
+	if (op == TLAND || op == TLOR) {
+		return context.builder->getInt1Ty();
+	}
+
+	ltype = lval.getExprType(context);
+	rtype = rval.getExprType(context);
+	if (!ltype || !rtype) {
+		return NULL;
+	}
+
+	if (ltype->isArrayTy()) {
+		ltype = ltype->getArrayElementType()->getPointerTo();
+	}
+	if (rtype->isArrayTy()) {
+		rtype = rtype->getArrayElementType()->getPointerTo();
+	}
+
+	if (ltype->isPointerTy()
+		&& rtype->isIntegerTy()
+		&& (op == TADD || op == TSUB)) {
+		return ltype;
+	}
+	if (rtype->isPointerTy()
+		&& ltype->isIntegerTy()
+		&& op == TADD) {
+		return rtype;
+	}
+
+	if (ltype->isPointerTy() && rtype->isPointerTy()) {
+		ltype = rtype = context.builder->getInt64Ty();
+	}
+
+	if (!(common_type = getCommonType(ltype, rtype))) {
+		if (ltype->isPointerTy()) {
+			common_type = rtype;
+		} else if (rtype->isPointerTy()) {
+			common_type = ltype;
+		} else {
+			return NExpression::resolveType(context);
+		}
+	}
+
+	switch (op) {
+		case TCEQ:
+		case TCNE:
+		case TCLT:
+		case TCGT:
+		case TCLE:
+		case TCGE:
+			return context.builder->getInt1Ty();
+	}
+
+	return common_type;
+}
+
+Type *
+NPrefixExpr::resolveType(CodeGenContext& context)
+{
+	Type *operand_type;
+	string backup;
+
+	switch (op) {
+		case -1: // cast
+			return type.getType(context);
+		case TSIZEOF:
+		case TALIGNOF:
+			return context.builder->getInt64Ty();
+		case TLNOT:
+			return context.builder->getInt1Ty();
+		case TDCOLON:
+			backup = context.current_namespace;
+			context.current_namespace = "";
+			operand_type = operand.getExprType(context);
+			context.current_namespace = backup;
+			return operand_type;
+	}
+
+	if (!(operand_type = operand.getExprType(context))) {
+		return NULL;
+	}
+
+	switch (op) {
+		case TMUL:
+			if (operand_type->isPointerTy()) {
+				return operand_type->getPointerElementType();
+			}
+			break;
+		case TAND:
+			return operand_type->getPointerTo();
+		case TINC:
+		case TDEC:
+		case TADD:
+		case TSUB:
+		case TNOT:
+			return operand_type;
+	}
+
+	return NExpression::resolveType(context);
+}
+
+Type *
+NLabelAddressExpr::resolveType(CodeGenContext& context)
+{
+	return context.builder->getInt8PtrTy();
+}
+
+Type *
+NExpectExpr::resolveType(CodeGenContext& context)
+{
+	return expected ? operand.getExprType(context) : context.builder->getInt1Ty();
+}
+
+Type *
+NIncDecExpr::resolveType(CodeGenContext& context)
+{
+	return operand.getExprType(context);
+}
+
+Type *
+NAssignmentExpr::resolveType(CodeGenContext& context)
+{
+	return lval.getExprType(context); // rhs is cast to the type of lval
+}
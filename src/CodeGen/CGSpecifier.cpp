@@ -24,9 +24,197 @@ NStaticSpecifier::setSpecifier(SpecifierSet *dest)
 	return;
 }
 
+void
+NInlineSpecifier::setSpecifier(SpecifierSet *dest)
+{
+	dest->is_inline = true;
+	dest->always_inline |= always;
+	return;
+}
+
 void
 NTypeSpecifier::setSpecifier(SpecifierSet *dest)
 {
 	dest->type = &type;
 	return;
 }
+
+void
+NAttributeSpecifier::setSpecifier(SpecifierSet *dest)
+{
+	dest->attributes.insert(dest->attributes.end(), attributes.begin(), attributes.end());
+	return;
+}
+
+NAttribute *
+findAttribute(AttributeSpecList *attributes, const char *name)
+{
+	AttributeSpecList::const_iterator attr_it;
+
+	if (!attributes) {
+		return NULL;
+	}
+
+	for (attr_it = attributes->begin(); attr_it != attributes->end(); attr_it++) {
+		if ((*attr_it)->is(name)) {
+			return *attr_it;
+		}
+	}
+
+	return NULL;
+}
+
+// value of aligned(N), 0 if there is no such attribute
+unsigned
+getAlignAttribute(CodeGenContext& context, AttributeSpecList *attributes,
+				  int lineno, char *file_name)
+{
+	NAttribute *attr = findAttribute(attributes, "aligned");
+	Value *align_val;
+	uint64_t align;
+
+	if (!attr) {
+		return 0;
+	}
+
+	if (!attr->args || attr->args->empty()) {
+		return 16; // biggest alignment of the target
+	}
+
+	align_val = (*attr->args)[0]->codeGen(context);
+	if (align_val && isa<ConstantInt>(align_val)) {
+		align = dyn_cast<ConstantInt>(align_val)->getZExtValue();
+	} else if (align_val && isa<Constant>(align_val)
+			   && align_val->getType()->isIntegerTy()) {
+		align = getConstantIntExprJIT(dyn_cast<Constant>(align_val));
+	} else {
+		align = 0;
+	}
+
+	if (!align || (align & (align - 1))) {
+		CGERR_Invalid_Alignment(context);
+		CGERR_setLineNum(context, lineno, file_name);
+		CGERR_showAllMsg(context);
+		return 0;
+	}
+
+	return align;
+}
+
+// __attribute__((optimize("fast-math", "no-wrapv", ...))) on a function
+ArithmeticMode
+getArithmeticMode(CodeGenContext& context, AttributeSpecList *attributes,
+				  int lineno, char *file_name)
+{
+	ArithmeticMode mode = context.default_arith;
+	AttributeSpecList::const_iterator attr_it;
+	ExpressionList::const_iterator arg_it;
+	NString *option_str;
+	std::string option;
+
+	for (attr_it = attributes->begin(); attr_it != attributes->end(); attr_it++) {
+		if (!(*attr_it)->is("optimize") || !(*attr_it)->args) {
+			continue;
+		}
+
+		for (arg_it = (*attr_it)->args->begin(); arg_it != (*attr_it)->args->end(); arg_it++) {
+			option = (option_str = dynamic_cast<NString *>(*arg_it)) ? option_str->value : "";
+			if (!option.compare(0, 2, "-f")) { // as on the command line
+				option = option.substr(2);
+			}
+
+			if (option == "fast-math") {
+				mode.fast_math = true;
+			} else if (option == "no-fast-math") {
+				mode.fast_math = false;
+			} else if (option == "fp-contract=fast") {
+				mode.fp_contract = true;
+			} else if (option == "fp-contract=off") {
+				mode.fp_contract = false;
+			} else if (option == "wrapv") {
+				mode.wrapv = true;
+			} else if (option == "no-wrapv") {
+				mode.wrapv = false;
+			} else {
+				CGERR_Unknown_Optimize_Option(context, option.c_str());
+				CGERR_setLineNum(context, lineno, file_name);
+				CGERR_showAllMsg(context);
+			}
+		}
+	}
+
+	return mode;
+}
+
+// function attributes of a declaration or definition, nounwind as there are no exceptions
+AttributeSet
+getFunctionAttributes(AttributeSpecList *attributes, Type *ret_type)
+{
+	AttrBuilder builder;
+	AttributeSet ret;
+
+	builder.addAttribute(Attribute::NoUnwind);
+
+	if (findAttribute(attributes, "cold")) {
+		builder.addAttribute(Attribute::Cold);
+		builder.addAttribute(Attribute::OptimizeForSize);
+	} else if (findAttribute(attributes, "hot")) {
+		builder.addAttribute(Attribute::InlineHint); // there is no hot attribute
+	}
+
+	if (findAttribute(attributes, "const")) {
+		builder.addAttribute(Attribute::ReadNone);
+	} else if (findAttribute(attributes, "pure")) {
+		builder.addAttribute(Attribute::ReadOnly);
+	}
+
+	if (findAttribute(attributes, "noinline")) {
+		builder.addAttribute(Attribute::NoInline);
+	} else if (findAttribute(attributes, "always_inline")) {
+		builder.addAttribute(Attribute::AlwaysInline);
+	}
+
+	if (findAttribute(attributes, "noreturn")) {
+		builder.addAttribute(Attribute::NoReturn);
+	}
+
+	ret = AttributeSet::get(getGlobalContext(), AttributeSet::FunctionIndex, builder);
+	if (findAttribute(attributes, "malloc") && ret_type->isPointerTy()) {
+		ret = ret.addAttribute(getGlobalContext(), AttributeSet::ReturnIndex, Attribute::NoAlias);
+	}
+
+	return ret;
+}
+
+// visibility("...") of an exported definition, -fvisibility= if there is none
+void
+setVisibility(CodeGenContext& context, GlobalValue *value, AttributeSpecList *attributes,
+			  int lineno, char *file_name)
+{
+	NAttribute *attr = findAttribute(attributes, "visibility");
+	GlobalValue::VisibilityTypes visibility = context.default_visibility;
+	NString *name_str;
+	std::string name;
+
+	if (value->hasLocalLinkage()) {
+		return;
+	}
+
+	if (attr && attr->args && !attr->args->empty()) {
+		name = (name_str = dynamic_cast<NString *>((*attr->args)[0])) ? name_str->value : "";
+		if (name == "default") {
+			visibility = GlobalValue::DefaultVisibility;
+		} else if (name == "hidden") {
+			visibility = GlobalValue::HiddenVisibility;
+		} else if (name == "protected") {
+			visibility = GlobalValue::ProtectedVisibility;
+		} else {
+			CGERR_Unknown_Visibility(context, name.c_str());
+			CGERR_setLineNum(context, lineno, file_name);
+			CGERR_showAllMsg(context);
+		}
+	}
+	value->setVisibility(visibility);
+
+	return;
+}
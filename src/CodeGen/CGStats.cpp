@@ -0,0 +1,318 @@
+#include "CGStats.h"
+#include <sstream>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cxxabi.h>
+#include <llvm/IR/Function.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Object/ObjectFile.h>
+
+using namespace llvm;
+
+CompilerStats compiler_stats;
+
+static string
+demangleClassName(const string& name)
+{
+	int status;
+	char *demangled = abi::__cxa_demangle(name.c_str(), NULL, NULL, &status);
+	string ret = (status == 0 && demangled ? demangled : name);
+
+	free(demangled);
+	return ret;
+}
+
+static string
+escapeJSON(const string& str)
+{
+	string ret;
+	string::const_iterator it;
+
+	for (it = str.begin(); it != str.end(); it++) {
+		switch (*it) {
+			case '"': ret += "\\\""; break;
+			case '\\': ret += "\\\\"; break;
+			case '\n': ret += "\\n"; break;
+			case '\t': ret += "\\t"; break;
+			default: ret += *it; break;
+		}
+	}
+
+	return ret;
+}
+
+class LLVMStatEntry {
+public:
+	uint64_t value;
+	string group;
+	string desc;
+};
+
+// PrintStatistics only has a text form: "  <value> <group> - <description>"
+static vector<LLVMStatEntry>
+collectLLVMStats()
+{
+	vector<LLVMStatEntry> ret;
+	string text;
+	raw_string_ostream strm(text);
+	istringstream lines;
+	string line;
+	unsigned long long value;
+	char group[256];
+	int desc_pos;
+
+	PrintStatistics(strm);
+	strm.flush();
+	lines.str(text);
+
+	while (getline(lines, line)) {
+		if (sscanf(line.c_str(), " %llu %255s - %n", &value, group, &desc_pos) == 2) {
+			LLVMStatEntry entry;
+			entry.value = value;
+			entry.group = group;
+			entry.desc = line.substr(desc_pos);
+			ret.push_back(entry);
+		}
+	}
+
+	return ret;
+}
+
+void
+CompilerStats::countFunction(Function *function)
+{
+	FunctionStats func_stats;
+	Function::const_iterator block_it;
+
+	func_stats.name = function->getName().str();
+	for (block_it = function->begin(); block_it != function->end(); block_it++) {
+		func_stats.block_count++;
+		func_stats.inst_count += block_it->size();
+	}
+	functions.push_back(func_stats);
+
+	return;
+}
+
+void
+CompilerStats::printText(ostream& strm)
+{
+	map<string, uint64_t>::const_iterator node_it;
+	vector<FunctionStats>::const_iterator func_it;
+	vector<LLVMStatEntry> llvm_stats = collectLLVMStats();
+	vector<LLVMStatEntry>::const_iterator stat_it;
+
+	strm << "===--- Compiler Statistics ---===" << endl;
+	strm << "tokens lexed:           " << tokens_lexed << endl;
+	strm << "type lookups/misses:    " << type_lookups << "/" << type_misses << endl;
+	strm << "struct lookups/misses:  " << struct_lookups << "/" << struct_misses << endl;
+	strm << "union lookups/misses:   " << union_lookups << "/" << union_misses << endl;
+	strm << "scope pushes:           " << scope_pushes << endl;
+	strm << "constant expr JIT runs: " << const_expr_jit << endl;
+	strm << "string literals:        " << string_literals << endl;
+	strm << "global ctor insts:      " << global_ctor_insts << endl;
+	strm << "lazy decls/emitted:     " << lazy_decls << "/" << lazy_materialized << endl;
+	strm << "lazy bodies/parsed:     " << lazy_bodies << "/" << lazy_bodies_parsed << endl;
+	strm << "front-end time (ms):    " << frontend_time * 1000 << endl;
+
+	strm << "AST nodes:" << endl;
+	for (node_it = ast_nodes.begin(); node_it != ast_nodes.end(); node_it++) {
+		strm << "  " << demangleClassName(node_it->first) << ": " << node_it->second << endl;
+	}
+
+	strm << "functions (blocks/insts):" << endl;
+	for (func_it = functions.begin(); func_it != functions.end(); func_it++) {
+		strm << "  " << func_it->name << ": "
+			 << func_it->block_count << "/" << func_it->inst_count << endl;
+	}
+
+	if (llvm_stats.size()) {
+		strm << "LLVM:" << endl;
+		for (stat_it = llvm_stats.begin(); stat_it != llvm_stats.end(); stat_it++) {
+			strm << "  " << stat_it->group << ": " << stat_it->value
+				 << " (" << stat_it->desc << ")" << endl;
+		}
+	}
+
+	return;
+}
+
+void
+CompilerStats::printJSON(ostream& strm)
+{
+	map<string, uint64_t>::const_iterator node_it;
+	vector<FunctionStats>::const_iterator func_it;
+	vector<LLVMStatEntry> llvm_stats = collectLLVMStats();
+	vector<LLVMStatEntry>::const_iterator stat_it;
+
+	strm << "{" << endl;
+	strm << "\t\"tokens_lexed\": " << tokens_lexed << "," << endl;
+	strm << "\t\"type_lookups\": " << type_lookups << "," << endl;
+	strm << "\t\"type_misses\": " << type_misses << "," << endl;
+	strm << "\t\"struct_lookups\": " << struct_lookups << "," << endl;
+	strm << "\t\"struct_misses\": " << struct_misses << "," << endl;
+	strm << "\t\"union_lookups\": " << union_lookups << "," << endl;
+	strm << "\t\"union_misses\": " << union_misses << "," << endl;
+	strm << "\t\"scope_pushes\": " << scope_pushes << "," << endl;
+	strm << "\t\"const_expr_jit\": " << const_expr_jit << "," << endl;
+	strm << "\t\"string_literals\": " << string_literals << "," << endl;
+	strm << "\t\"global_ctor_insts\": " << global_ctor_insts << "," << endl;
+	strm << "\t\"lazy_decls\": " << lazy_decls << "," << endl;
+	strm << "\t\"lazy_materialized\": " << lazy_materialized << "," << endl;
+	strm << "\t\"lazy_bodies\": " << lazy_bodies << "," << endl;
+	strm << "\t\"lazy_bodies_parsed\": " << lazy_bodies_parsed << "," << endl;
+	strm << "\t\"frontend_time_ms\": " << frontend_time * 1000 << "," << endl;
+
+	strm << "\t\"ast_nodes\": {";
+	for (node_it = ast_nodes.begin(); node_it != ast_nodes.end(); node_it++) {
+		strm << (node_it == ast_nodes.begin() ? "" : ",") << endl
+			 << "\t\t\"" << escapeJSON(demangleClassName(node_it->first)) << "\": " << node_it->second;
+	}
+	strm << endl << "\t}," << endl;
+
+	strm << "\t\"functions\": [";
+	for (func_it = functions.begin(); func_it != functions.end(); func_it++) {
+		strm << (func_it == functions.begin() ? "" : ",") << endl
+			 << "\t\t{ \"name\": \"" << escapeJSON(func_it->name) << "\""
+			 << ", \"blocks\": " << func_it->block_count
+			 << ", \"insts\": " << func_it->inst_count << " }";
+	}
+	strm << endl << "\t]," << endl;
+
+	strm << "\t\"llvm\": [";
+	for (stat_it = llvm_stats.begin(); stat_it != llvm_stats.end(); stat_it++) {
+		strm << (stat_it == llvm_stats.begin() ? "" : ",") << endl
+			 << "\t\t{ \"group\": \"" << escapeJSON(stat_it->group) << "\""
+			 << ", \"desc\": \"" << escapeJSON(stat_it->desc) << "\""
+			 << ", \"value\": " << stat_it->value << " }";
+	}
+	strm << endl << "\t]" << endl;
+	strm << "}" << endl;
+
+	return;
+}
+
+void
+CompilerStats::readObjectSizes(const string& object_path)
+{
+	ErrorOr<object::ObjectFile *> object_or_err = object::ObjectFile::createObjectFile(object_path);
+	object::ObjectFile *object_file;
+	map<string, FunctionCost>::iterator cost_it;
+	StringRef sym_name;
+	uint64_t sym_size;
+
+	if (!object_or_err) {
+		cerr << "Cannot read object file " << object_path << ": "
+			 << object_or_err.getError().message() << endl;
+		return;
+	}
+	object_file = object_or_err.get();
+
+	for (object::symbol_iterator sym_it = object_file->symbol_begin();
+		 sym_it != object_file->symbol_end(); sym_it++) {
+		if (sym_it->getName(sym_name) || sym_it->getSize(sym_size)) {
+			continue;
+		}
+
+		cost_it = costs.find(sym_name.str());
+		if (cost_it == costs.end() && sym_name.startswith("_")) { // Mach-O prefix
+			cost_it = costs.find(sym_name.substr(1).str());
+		}
+		if (cost_it != costs.end()) {
+			cost_it->second.mc_size = sym_size;
+		}
+	}
+
+	delete object_file;
+	return;
+}
+
+static bool
+compareCodeGenTime(const FunctionCost& a, const FunctionCost& b)
+{
+	return a.codegen_time > b.codegen_time;
+}
+
+static bool
+compareIRInsts(const FunctionCost& a, const FunctionCost& b)
+{
+	return a.ir_insts > b.ir_insts;
+}
+
+static bool
+compareOptTime(const FunctionCost& a, const FunctionCost& b)
+{
+	return a.opt_time > b.opt_time;
+}
+
+static bool
+compareMCSize(const FunctionCost& a, const FunctionCost& b)
+{
+	return a.mc_size > b.mc_size;
+}
+
+static void
+printCostEntry(ostream& strm, const FunctionCost& cost, const string& value)
+{
+	strm << "  " << value << "\t" << cost.name << " ("
+		 << (cost.file_name.empty() ? "<unknown>" : cost.file_name) << ":" << cost.lineno << ")"
+		 << (cost.opt_skipped ? " [not optimized: over budget]" : "") << endl;
+	return;
+}
+
+void
+CompilerStats::printCostReport(ostream& strm, unsigned top_n)
+{
+	vector<FunctionCost> sorted;
+	map<string, FunctionCost>::const_iterator cost_it;
+	unsigned i;
+	ostringstream value;
+
+	for (cost_it = costs.begin(); cost_it != costs.end(); cost_it++) {
+		sorted.push_back(cost_it->second);
+	}
+	top_n = min<unsigned>(top_n, sorted.size());
+
+	strm << "===--- Function Compile Cost (top " << top_n << ") ---===" << endl;
+
+	strm << "front-end codegen time (ms):" << endl;
+	std::sort(sorted.begin(), sorted.end(), compareCodeGenTime);
+	for (i = 0; i < top_n; i++) {
+		value.str("");
+		value << sorted[i].codegen_time * 1000;
+		printCostEntry(strm, sorted[i], value.str());
+	}
+
+	strm << "IR instructions:" << endl;
+	std::sort(sorted.begin(), sorted.end(), compareIRInsts);
+	for (i = 0; i < top_n; i++) {
+		value.str("");
+		value << sorted[i].ir_insts;
+		printCostEntry(strm, sorted[i], value.str());
+	}
+
+	strm << "optimization time (ms, function passes):" << endl;
+	std::sort(sorted.begin(), sorted.end(), compareOptTime);
+	for (i = 0; i < top_n; i++) {
+		value.str("");
+		value << sorted[i].opt_time * 1000;
+		printCostEntry(strm, sorted[i], value.str());
+	}
+	strm << "  " << module_opt_time * 1000 << "\t<module passes, unattributed>" << endl;
+
+	strm << "machine code size (bytes):" << endl;
+	std::sort(sorted.begin(), sorted.end(), compareMCSize);
+	for (i = 0; i < top_n; i++) {
+		value.str("");
+		if (sorted[i].mc_size < 0) {
+			value << "-";
+		} else {
+			value << sorted[i].mc_size;
+		}
+		printCostEntry(strm, sorted[i], value.str());
+	}
+
+	return;
+}
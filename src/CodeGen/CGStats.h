@@ -0,0 +1,106 @@
+#ifndef _CGSTATS_H_
+#define _CGSTATS_H_
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <stdint.h>
+
+namespace llvm {
+	class Function;
+}
+
+using namespace std;
+
+#define STATS_INC(field) (compiler_stats.field++)
+
+class FunctionStats {
+public:
+	string name;
+	uint64_t block_count = 0;
+	uint64_t inst_count = 0;
+};
+
+class FunctionCost {
+public:
+	string name;
+	string file_name;
+	int lineno = -1;
+	double codegen_time = 0.0; // seconds
+	double opt_time = 0.0;
+	uint64_t ir_insts = 0;
+	int64_t mc_size = -1; // -1 if no object file was emitted
+	bool opt_skipped = false;
+};
+
+class CompilerStats {
+	set<const void *> counted_nodes;
+
+public:
+	bool enabled = false;
+
+	uint64_t tokens_lexed = 0;
+	map<string, uint64_t> ast_nodes; // mangled class name -> count
+
+	uint64_t type_lookups = 0;
+	uint64_t type_misses = 0;
+	uint64_t struct_lookups = 0;
+	uint64_t struct_misses = 0;
+	uint64_t union_lookups = 0;
+	uint64_t union_misses = 0;
+	uint64_t scope_pushes = 0;
+	uint64_t const_expr_jit = 0;
+	uint64_t string_literals = 0;
+	uint64_t global_ctor_insts = 0;
+	uint64_t lazy_decls = 0;
+	uint64_t lazy_materialized = 0;
+	uint64_t lazy_bodies = 0;
+	uint64_t lazy_bodies_parsed = 0;
+	double frontend_time = 0.0; // seconds spent parsing and generating IR
+
+	vector<FunctionStats> functions;
+
+	bool track_costs = false;
+	map<string, FunctionCost> costs; // function name -> cost
+	double module_opt_time = 0.0; // module pipeline (inliner, IPO), not attributed to functions
+
+	// count each node once even if SETLINE is applied again when it is reduced
+	inline void
+	countNode(const void *node, const char *class_name)
+	{
+		if (enabled && counted_nodes.insert(node).second) {
+			ast_nodes[class_name]++;
+		}
+		return;
+	}
+
+	// nodes of a finished top-level statement are never reduced again,
+	// and may be freed (and their addresses reused) in streaming mode
+	inline void
+	clearCountedNodes()
+	{
+		counted_nodes.clear();
+		return;
+	}
+
+	void countFunction(llvm::Function *function);
+
+	inline FunctionCost&
+	getCost(const string& name)
+	{
+		FunctionCost& cost = costs[name];
+		cost.name = name;
+		return cost;
+	}
+	void readObjectSizes(const string& object_path);
+	void printCostReport(ostream& strm, unsigned top_n);
+
+	void printText(ostream& strm);
+	void printJSON(ostream& strm);
+};
+
+extern CompilerStats compiler_stats;
+
+#endif
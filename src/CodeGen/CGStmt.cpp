@@ -9,6 +9,25 @@
 #define getLine(p) (((NStatement *)this)->lineno)
 #define getFile(p) (((NStatement *)this)->file_name)
 
+// expressions used as statements only have their own lineno set
+static void
+setStatementLocation(CodeGenContext& context, NStatement *stmt)
+{
+	NExpression *expr = dynamic_cast<NExpression *>(stmt);
+
+	if (!stmt) {
+		return;
+	}
+
+	if (expr) {
+		context.setDebugLocation(expr->lineno, expr->file_name);
+	} else {
+		context.setDebugLocation(stmt->lineno, stmt->file_name);
+	}
+
+	return;
+}
+
 CGValue
 NBlock::codeGen(CodeGenContext& context)
 {
@@ -18,6 +37,7 @@ NBlock::codeGen(CodeGenContext& context)
 
 	for (it = statements.begin(); it != statements.end(); it++) {
 		if (*it) {
+			setStatementLocation(context, *it);
 			last = (**it).codeGen(context);
 		}
 	}
@@ -29,114 +49,376 @@ NBlock::codeGen(CodeGenContext& context)
 CGValue
 NReturnStatement::codeGen(CodeGenContext& context)
 {
-	Value *tmp_val = expression.codeGen(context);
+	Function *function = context.currentBlock()->getParent();
+	Value *tmp_val;
 	Value *ret_val;
+	CallInst *call;
+	const char *reason = NULL;
+
+	context.must_tail = must_tail;
+	tmp_val = expression.codeGen(context);
+	context.must_tail = false;
 
 	if (tmp_val) {
-		ret_val = NAssignmentExpr::doAssignCast(context, tmp_val,
-												context.currentBlock()->getParent()->getReturnType(),
+		ret_val = NAssignmentExpr::doAssignCast(context, tmp_val, function->getReturnType(),
 												NULL, getLine(this), getFile(this));
 	} else {
+		ret_val = NULL;
+	}
+
+	// return f(...) is a tail call unless a local escapes, see markTailCalls
+	call = dyn_cast_or_null<CallInst>(tmp_val);
+	if (must_tail) {
+		if (!call) {
+			reason = "the returned value is not a call";
+		} else if (ret_val != call) {
+			reason = "the callee returns another type";
+		} else if (call->getCalledValue()->getType()->getPointerElementType() != function->getFunctionType()) {
+			reason = "the callee and the caller have different signatures";
+		}
+
+		if (reason) {
+			CGERR_Cannot_Tail_Call(context, reason);
+			CGERR_setLineNum(context, getLine(this), getFile(this));
+			CGERR_showAllMsg(context);
+			return CGValue();
+		}
+		call->setTailCallKind(CallInst::TCK_MustTail);
+	} else if (call && ret_val == call) {
+		context.addTailCall(call);
+	}
+
+	if (!ret_val || ret_val->getType()->isVoidTy()) {
 		return CGValue(context.builder->CreateRetVoid());
 	}
 
 	return CGValue(context.builder->CreateRet(ret_val));
 }
 
-CGValue
-NWhileStatement::codeGen(CodeGenContext& context)
+// distinct self-referencing node that identifies one loop to the loop passes
+static MDNode *
+createLoopID(std::vector<Value *>& hints)
 {
-	BasicBlock *orig_end_block;
-	BasicBlock *orig_break_block;
-	BasicBlock *orig_continue_block;
-	BasicBlock *orig_block;
-	BasicBlock *cond_block;
-	BasicBlock *while_true_block;
-	BasicBlock *end_block;
-	Value *cond;
+	MDNode *temp_node = MDNode::getTemporary(getGlobalContext(), None);
+	MDNode *loop_id;
 
-	orig_block = context.currentBlock();
-	orig_end_block = context.current_end_block;
-	orig_break_block = context.current_break_block;
-	orig_continue_block = context.current_continue_block;
+	hints.insert(hints.begin(), temp_node);
+	loop_id = MDNode::get(getGlobalContext(), hints);
+	loop_id->replaceOperandWith(0, loop_id);
+	MDNode::deleteTemporary(temp_node);
 
-	cond_block = BasicBlock::Create(getGlobalContext(), "", orig_block->getParent(),
-									orig_end_block);
-	BranchInst::Create(cond_block, orig_block); // auto jump to cond block
-	setBlock(cond_block);
+	return loop_id;
+}
 
-	cond = context.builder->CreateIsNotNull(condition.codeGen(context), "");
-	orig_block = context.currentBlock();
+#define LOOP_PRAGMA_TAG ("phi.loop.pragma")
 
-	end_block = BasicBlock::Create(getGlobalContext(), "", orig_block->getParent(),
-								   orig_end_block);
-	context.current_end_block = end_block;
-	context.current_break_block = end_block;
-	context.current_continue_block = cond_block;
+static MDNode *
+createLoopHint(const char *name, unsigned value)
+{
+	Value *operands[] = {
+		MDString::get(getGlobalContext(), name),
+		ConstantInt::get(Type::getInt32Ty(getGlobalContext()), value)
+	};
 
-	while_true_block = BasicBlock::Create(getGlobalContext(), "", orig_block->getParent(),
-										  context.current_end_block);
+	return MDNode::get(getGlobalContext(), operands);
+}
 
-	setBlock(while_true_block);
-	while_true->codeGen(context);
-	context.builder->CreateBr(cond_block); // rejudge
+// integer literal argument of a hint, or one of the words enable/disable/full;
+// hints are added once the loop is built, so nothing may be lowered here
+static bool
+getLoopHintArg(CodeGenContext& context, NExpression& arg, uint64_t& value, string& word)
+{
+	Value *arg_val;
 
-	context.popBlock();
+	if (typeid(arg) == typeid(NIdentifier)) {
+		word = ((NIdentifier&)arg).name;
+		return word == "enable" || word == "disable" || word == "full";
+	}
 
-	context.current_end_block = orig_end_block; // restore info
-	context.current_break_block = orig_break_block;
-	context.current_continue_block = orig_continue_block;
-	setBlock(end_block); // insert other insts at end block
+	if (typeid(arg) != typeid(NInteger)) {
+		return false;
+	}
 
-	return CGValue(BranchInst::Create(while_true_block, end_block, cond, orig_block));
+	arg_val = arg.codeGen(context); // a constant, no instruction
+	if (arg_val && isa<ConstantInt>(arg_val)) {
+		value = dyn_cast<ConstantInt>(arg_val)->getZExtValue();
+		return true;
+	}
+
+	return false;
 }
 
-CGValue
-NForStatement::codeGen(CodeGenContext& context)
+/*
+ * #pragma loop unroll(N|full|disable) vectorize(width=N|N|enable|disable)
+ *              interleave(N|disable)
+ * lowered to the llvm.loop hints of the loop vectorizer and unroller
+ */
+static void
+addLoopHints(CodeGenContext& context, LoopHintList *loop_hints,
+			 std::vector<Value *>& hints, int lineno, char *file_name)
 {
-	BasicBlock *orig_end_block;
-	BasicBlock *orig_break_block;
-	BasicBlock *orig_continue_block;
-	BasicBlock *orig_block;
-	BasicBlock *cond_block;
-	BasicBlock *for_true_block;
-	BasicBlock *tail_block;
+	LoopHintList::const_iterator hint_it;
+	NExpression *arg;
+	LoopPragma pragma;
+	uint64_t value;
+	string word;
+
+	if (!loop_hints) {
+		return;
+	}
+
+	pragma.lineno = lineno;
+	pragma.file_name = file_name;
+
+	for (hint_it = loop_hints->begin(); hint_it != loop_hints->end(); hint_it++) {
+		const char *name = (*hint_it)->name.c_str();
+
+		if ((*hint_it)->name != "unroll"
+			&& (*hint_it)->name != "vectorize"
+			&& (*hint_it)->name != "interleave") {
+			CGERR_Unknown_Loop_Hint(context, name);
+			CGERR_setLineNum(context, (*hint_it)->lineno, (*hint_it)->file_name);
+			CGERR_showAllMsg(context);
+			continue;
+		}
+
+		arg = &(*hint_it)->arg;
+		if ((*hint_it)->name == "vectorize" && typeid(*arg) == typeid(NAssignmentExpr)
+			&& typeid(((NAssignmentExpr *)arg)->lval) == typeid(NIdentifier)
+			&& ((NIdentifier&)((NAssignmentExpr *)arg)->lval).name == "width") { // width=N
+			arg = &((NAssignmentExpr *)arg)->rval;
+		}
+
+		value = 0;
+		word = "";
+		if (!getLoopHintArg(context, *arg, value, word)) {
+			CGERR_Invalid_Loop_Hint_Argument(context, name);
+			CGERR_setLineNum(context, (*hint_it)->lineno, (*hint_it)->file_name);
+			CGERR_showAllMsg(context);
+			return;
+		}
+
+		if ((*hint_it)->name == "unroll") {
+			if (word == "disable") {
+				hints.push_back(MDNode::get(getGlobalContext(),
+											MDString::get(getGlobalContext(), "llvm.loop.unroll.disable")));
+			} else if (word == "full" || word == "enable") {
+				hints.push_back(MDNode::get(getGlobalContext(),
+											MDString::get(getGlobalContext(), "llvm.loop.unroll.full")));
+				pragma.unroll = true;
+			} else {
+				hints.push_back(createLoopHint("llvm.loop.unroll.count", value));
+				pragma.unroll = value > 1;
+			}
+		} else if ((*hint_it)->name == "vectorize") {
+			if (word == "disable") {
+				hints.push_back(createLoopHint("llvm.loop.vectorize.width", 1));
+			} else if (word == "full" || word == "enable") {
+				hints.push_back(createLoopHint("llvm.loop.vectorize.enable", 1));
+				pragma.vectorize = true;
+			} else {
+				hints.push_back(createLoopHint("llvm.loop.vectorize.width", value));
+				pragma.vectorize = value > 1;
+			}
+		} else { // interleave
+			if (word == "disable") {
+				hints.push_back(createLoopHint("llvm.loop.interleave.count", 1));
+			} else {
+				hints.push_back(createLoopHint("llvm.loop.interleave.count", word.empty() ? value : 0));
+				pragma.interleave = word.empty() && value > 1;
+			}
+		}
+	}
+
+	// tag the loop so checkLoopPragmas can find it after optimization
+	if (pragma.unroll || pragma.vectorize || pragma.interleave) {
+		hints.push_back(createLoopHint(LOOP_PRAGMA_TAG, context.loop_pragmas.size()));
+		context.loop_pragmas.push_back(pragma);
+	}
+
+	return;
+}
+
+static ConstantInt *
+getLoopHintValue(MDNode *loop_id, const char *name, bool *found)
+{
+	MDNode *hint;
+	MDString *hint_name;
+	unsigned i;
+
+	for (i = 1; i < loop_id->getNumOperands(); i++) {
+		if ((hint = dyn_cast_or_null<MDNode>(loop_id->getOperand(i)))
+			&& hint->getNumOperands()
+			&& (hint_name = dyn_cast_or_null<MDString>(hint->getOperand(0)))
+			&& hint_name->getString() == name) {
+			*found = true;
+			return hint->getNumOperands() > 1 ? dyn_cast_or_null<ConstantInt>(hint->getOperand(1)) : NULL;
+		}
+	}
+
+	*found = false;
+	return NULL;
+}
+
+/*
+ * the vectorizer marks what it transformed with vectorize.width/interleave.count 1
+ * and the unroller leaves unroll.disable, loops that are gone were fully unrolled or deleted
+ */
+void
+CodeGenContext::checkLoopPragmas()
+{
+	std::vector<bool> unvectorized(loop_pragmas.size(), false);
+	std::vector<bool> uninterleaved(loop_pragmas.size(), false);
+	std::vector<bool> unrolled_missing(loop_pragmas.size(), false);
+	Module::iterator func_it;
+	Function::iterator block_it;
+	MDNode *loop_id;
+	ConstantInt *hint_val;
+	uint64_t id;
+	bool found;
+	unsigned i;
+
+	if (loop_pragmas.empty()) {
+		return;
+	}
+
+	for (func_it = module->begin(); func_it != module->end(); func_it++) {
+		for (block_it = func_it->begin(); block_it != func_it->end(); block_it++) {
+			if (!block_it->getTerminator()
+				|| !(loop_id = block_it->getTerminator()->getMetadata("llvm.loop"))
+				|| !(hint_val = getLoopHintValue(loop_id, LOOP_PRAGMA_TAG, &found))) {
+				continue;
+			}
+
+			id = hint_val->getZExtValue();
+			if (id >= loop_pragmas.size()) {
+				continue;
+			}
+
+			hint_val = getLoopHintValue(loop_id, "llvm.loop.vectorize.width", &found);
+			if (loop_pragmas[id].vectorize && !(hint_val && hint_val->isOne())) {
+				unvectorized[id] = true;
+			}
+			hint_val = getLoopHintValue(loop_id, "llvm.loop.interleave.count", &found);
+			if (loop_pragmas[id].interleave && !(hint_val && hint_val->isOne())) {
+				uninterleaved[id] = true;
+			}
+			getLoopHintValue(loop_id, "llvm.loop.unroll.disable", &found);
+			if (loop_pragmas[id].unroll && !found) {
+				unrolled_missing[id] = true;
+			}
+		}
+	}
+
+	for (i = 0; i < loop_pragmas.size(); i++) {
+		if (unvectorized[i]) {
+			CGERR_Loop_Hint_Not_Applied(*this, "vectorization");
+			CGERR_setLineNum(*this, loop_pragmas[i].lineno, loop_pragmas[i].file_name);
+		}
+		if (uninterleaved[i]) {
+			CGERR_Loop_Hint_Not_Applied(*this, "interleaving");
+			CGERR_setLineNum(*this, loop_pragmas[i].lineno, loop_pragmas[i].file_name);
+		}
+		if (unrolled_missing[i]) {
+			CGERR_Loop_Hint_Not_Applied(*this, "unrolling");
+			CGERR_setLineNum(*this, loop_pragmas[i].lineno, loop_pragmas[i].file_name);
+		}
+	}
+	CGERR_showAllMsg(*this);
+
+	return;
+}
+
+// NULL for an empty condition, i.e. loop forever
+static Value *
+emitLoopCondition(CodeGenContext& context, NExpression& condition)
+{
+	Value *cond;
+
+	context.setDebugLocation(condition.lineno, condition.file_name);
+	cond = condition.codeGen(context);
+
+	return cond ? context.builder->CreateIsNotNull(cond, "") : NULL;
+}
+
+/*
+ * Loops are emitted rotated:
+ *   guard:     cond ? preheader : end
+ *   preheader: body
+ *   body:      ... latch
+ *   latch:     [tail] cond ? body : exit   (!llvm.loop)
+ *   exit:      end
+ * so every loop has a dedicated preheader, a single latch and dedicated exits.
+ * continue jumps to the latch, break to the exit.
+ */
+static BranchInst *
+emitRotatedLoop(CodeGenContext& context, NExpression& condition,
+				NStatement *body, NExpression *tail,
+				LoopHintList *loop_hints, int lineno, char *file_name)
+{
+	BasicBlock *orig_end_block = context.current_end_block;
+	BasicBlock *orig_break_block = context.current_break_block;
+	BasicBlock *orig_continue_block = context.current_continue_block;
+	Function *function = context.currentBlock()->getParent();
+	BasicBlock *preheader_block;
+	BasicBlock *body_block;
+	BasicBlock *latch_block;
+	BasicBlock *exit_block;
 	BasicBlock *end_block;
+	BranchInst *latch_br;
+	BranchInst *guard_br;
+	std::vector<Value *> hints;
 	Value *cond;
+	unsigned profile_slot;
 
-	initializer.codeGen(context);
-	orig_block = context.currentBlock();
-	orig_end_block = context.current_end_block;
-	orig_break_block = context.current_break_block;
-	orig_continue_block = context.current_continue_block;
+	cond = emitLoopCondition(context, condition);
 
-	cond_block = BasicBlock::Create(getGlobalContext(), "", orig_block->getParent(),
-									orig_end_block);
-	BranchInst::Create(cond_block, orig_block); // auto jump to cond block
-	setBlock(cond_block);
+	preheader_block = BasicBlock::Create(getGlobalContext(), "", function, orig_end_block);
+	body_block = BasicBlock::Create(getGlobalContext(), "", function, orig_end_block);
+	latch_block = BasicBlock::Create(getGlobalContext(), "", function, orig_end_block);
+	exit_block = BasicBlock::Create(getGlobalContext(), "", function, orig_end_block);
+	end_block = BasicBlock::Create(getGlobalContext(), "", function, orig_end_block);
 
-	if (cond = condition.codeGen(context)) {
-		cond = context.builder->CreateIsNotNull(condition.codeGen(context), "");
+	if (cond) {
+		profile_slot = context.countBranch(cond);
+		guard_br = context.builder->CreateCondBr(cond, preheader_block, end_block);
+		context.setBranchWeights(guard_br, profile_slot, condition.getBranchHint());
+	} else {
+		context.builder->CreateBr(preheader_block);
 	}
-	orig_block = context.currentBlock();
 
-	end_block = BasicBlock::Create(getGlobalContext(), "", orig_block->getParent(),
-								   orig_end_block);
-	context.current_end_block = end_block;
-	for_true_block = BasicBlock::Create(getGlobalContext(), "", orig_block->getParent(),
-										context.current_end_block);
-	tail_block = BasicBlock::Create(getGlobalContext(), "", orig_block->getParent(),
-									context.current_end_block);
-	context.current_break_block = end_block;
-	context.current_continue_block = tail_block;
+	setBlock(preheader_block);
+	context.builder->CreateBr(body_block);
+
+	context.current_end_block = latch_block;
+	context.current_break_block = exit_block;
+	context.current_continue_block = latch_block;
 
-	setBlock(for_true_block);
-	for_true->codeGen(context);
-	context.builder->CreateBr(tail_block); // goto tail
+	setBlock(body_block);
+	setStatementLocation(context, body);
+	body->codeGen(context);
+	if (!context.currentBlock()->getTerminator()) {
+		context.builder->CreateBr(latch_block);
+	}
+
+	context.current_end_block = exit_block;
+	setBlock(latch_block);
+	if (tail) {
+		context.setDebugLocation(tail->lineno, tail->file_name);
+		tail->codeGen(context);
+	}
+	if (cond = emitLoopCondition(context, condition)) {
+		profile_slot = context.countBranch(cond);
+		latch_br = context.builder->CreateCondBr(cond, body_block, exit_block);
+		context.setBranchWeights(latch_br, profile_slot, condition.getBranchHint());
+	} else {
+		latch_br = context.builder->CreateBr(body_block);
+	}
+	addLoopHints(context, loop_hints, hints, lineno, file_name);
+	latch_br->setMetadata("llvm.loop", createLoopID(hints));
 
-	setBlock(tail_block);
-	tail.codeGen(context);
-	context.builder->CreateBr(cond_block); // rejudge
+	setBlock(exit_block);
+	context.builder->CreateBr(end_block);
 
 	context.popBlock();
 
@@ -145,11 +427,24 @@ NForStatement::codeGen(CodeGenContext& context)
 	context.current_continue_block = orig_continue_block;
 	setBlock(end_block); // insert other insts at end block
 
-	if (!cond) {
-		return BranchInst::Create(for_true_block, orig_block);
-	}
+	return latch_br;
+}
 
-	return CGValue(BranchInst::Create(for_true_block, end_block, cond, orig_block));
+CGValue
+NWhileStatement::codeGen(CodeGenContext& context)
+{
+	return CGValue(emitRotatedLoop(context, condition, while_true, NULL,
+								   loop_hints, getLine(this), getFile(this)));
+}
+
+CGValue
+NForStatement::codeGen(CodeGenContext& context)
+{
+	context.setDebugLocation(initializer.lineno, initializer.file_name);
+	initializer.codeGen(context);
+
+	return CGValue(emitRotatedLoop(context, condition, for_true, &tail,
+								   loop_hints, getLine(this), getFile(this)));
 }
 
 CGValue
@@ -160,9 +455,13 @@ NIfStatement::codeGen(CodeGenContext& context)
 	BasicBlock *if_true_block;
 	BasicBlock *if_else_block; // optional
 	BasicBlock *end_block;
+	BranchInst *br;
 	Value *cond;
+	unsigned profile_slot;
 
+	context.setDebugLocation(condition.lineno, condition.file_name);
 	cond = context.builder->CreateIsNotNull(condition.codeGen(context), "");
+	profile_slot = context.countBranch(cond);
 
 	// record info
 	orig_block = context.currentBlock();
@@ -176,6 +475,7 @@ NIfStatement::codeGen(CodeGenContext& context)
 	if_true_block = BasicBlock::Create(getGlobalContext(), "", orig_block->getParent(),
 									   context.current_end_block);
 	setBlock(if_true_block);
+	setStatementLocation(context, if_true);
 	if_true->codeGen(context);
 
 	if (!context.currentBlock()->getTerminator()) {
@@ -187,6 +487,7 @@ NIfStatement::codeGen(CodeGenContext& context)
 		if_else_block = BasicBlock::Create(getGlobalContext(), "", orig_block->getParent(),
 										   context.current_end_block);
 		setBlock(if_else_block);
+		setStatementLocation(context, if_else);
 		if_else->codeGen(context);
 		if (!context.currentBlock()->getTerminator()) {
 			BranchInst::Create(end_block, context.currentBlock()); // goto end block (if don't have a terminator)
@@ -196,7 +497,10 @@ NIfStatement::codeGen(CodeGenContext& context)
 		context.current_end_block = orig_end_block; // restore info
 		setBlock(end_block); // insert other insts at end block
 
-		return CGValue(BranchInst::Create(if_true_block, if_else_block, cond, orig_block)); // insert branch at original block
+		br = BranchInst::Create(if_true_block, if_else_block, cond, orig_block); // insert branch at original block
+		context.setBranchWeights(br, profile_slot, condition.getBranchHint());
+
+		return CGValue(br);
 	}
 
 	// else (no if_else)
@@ -207,7 +511,10 @@ NIfStatement::codeGen(CodeGenContext& context)
 		context.builder->SetInsertPoint(end_block->getTerminator());
 	}
 
-	return CGValue(BranchInst::Create(if_true_block, end_block, cond, orig_block));
+	br = BranchInst::Create(if_true_block, end_block, cond, orig_block);
+	context.setBranchWeights(br, profile_slot, condition.getBranchHint());
+
+	return CGValue(br);
 }
 
 CGValue
@@ -229,6 +536,116 @@ NLabelStatement::codeGen(CodeGenContext& context)
 	}
 
 	setBlock(labeled_block);
+	setStatementLocation(context, &statement);
+
+	return statement.codeGen(context);
+}
+
+/*
+ * switch is lowered to one switch instruction, each case and default label
+ * starts a block of its own and the previous one falls through into it;
+ * break leaves to the end block, which is also the default without a label
+ */
+CGValue
+NSwitchStatement::codeGen(CodeGenContext& context)
+{
+	BasicBlock *orig_end_block = context.current_end_block;
+	BasicBlock *orig_break_block = context.current_break_block;
+	SwitchInst *orig_switch = context.current_switch;
+	bool orig_has_default = context.current_switch_has_default;
+	Function *function = context.currentBlock()->getParent();
+	BasicBlock *end_block;
+	SwitchInst *switch_inst;
+	Value *cond;
+
+	context.setDebugLocation(condition.lineno, condition.file_name);
+	cond = condition.codeGen(context);
+	if (!cond || !cond->getType()->isIntegerTy()) {
+		CGERR_Invalid_Switch_Condition(context);
+		CGERR_setLineNum(context, getLine(this), getFile(this));
+		CGERR_showAllMsg(context);
+		return CGValue();
+	}
+
+	end_block = BasicBlock::Create(getGlobalContext(), "", function, orig_end_block);
+	switch_inst = context.builder->CreateSwitch(cond, end_block);
+
+	context.current_end_block = end_block;
+	context.current_break_block = end_block;
+	context.current_switch = switch_inst;
+	context.current_switch_has_default = false;
+
+	// statements before the first label are unreachable
+	setBlock(BasicBlock::Create(getGlobalContext(), "", function, end_block));
+	setStatementLocation(context, body);
+	body->codeGen(context);
+	if (!context.currentBlock()->getTerminator()) {
+		context.builder->CreateBr(end_block);
+	}
+	context.popBlock();
+
+	context.current_end_block = orig_end_block; // restore info
+	context.current_break_block = orig_break_block;
+	context.current_switch = orig_switch;
+	context.current_switch_has_default = orig_has_default;
+	setBlock(end_block);
+
+	return CGValue(switch_inst);
+}
+
+CGValue
+NCaseStatement::codeGen(CodeGenContext& context)
+{
+	SwitchInst *switch_inst = context.current_switch;
+	BasicBlock *case_block;
+	Value *val = NULL;
+	ConstantInt *case_val = NULL;
+
+	if (!switch_inst) {
+		CGERR_Case_Without_Switch(context);
+		CGERR_setLineNum(context, getLine(this), getFile(this));
+		CGERR_showAllMsg(context);
+		return CGValue();
+	}
+
+	if (value) {
+		val = value->codeGen(context);
+		if (val && isa<Constant>(val) && val->getType()->isIntegerTy()) {
+			case_val = dyn_cast<ConstantInt>(ConstantExpr::getIntegerCast(dyn_cast<Constant>(val),
+																		  switch_inst->getCondition()->getType(),
+																		  true));
+		}
+		if (!case_val) {
+			CGERR_Non_Constant_Case(context);
+			CGERR_setLineNum(context, getLine(this), getFile(this));
+			CGERR_showAllMsg(context);
+			return CGValue();
+		}
+	}
+
+	if (case_val ? switch_inst->findCaseValue(case_val) != switch_inst->case_default()
+				 : context.current_switch_has_default) {
+		CGERR_Duplicate_Case(context);
+		CGERR_setLineNum(context, getLine(this), getFile(this));
+		CGERR_showAllMsg(context);
+		return CGValue();
+	}
+
+	case_block = BasicBlock::Create(getGlobalContext(), "", context.currentBlock()->getParent(),
+									context.current_end_block);
+	if (!context.currentBlock()->getTerminator()) { // fall through
+		BranchInst::Create(case_block, context.currentBlock());
+	}
+
+	if (case_val) {
+		switch_inst->addCase(case_val, case_block);
+	} else {
+		switch_inst->setDefaultDest(case_block);
+		context.current_switch_has_default = true;
+	}
+
+	setBlock(case_block);
+	setStatementLocation(context, &statement);
 
 	return statement.codeGen(context);
 }
@@ -237,7 +654,29 @@ CGValue
 NGotoStatement::codeGen(CodeGenContext& context)
 {
 	BranchInst *br_inst;
+	IndirectBrInst *indirect_br;
 	BasicBlock *dest_block;
+	Value *addr;
+
+	if (target) {
+		addr = target->codeGen(context);
+		if (!addr || !addr->getType()->isPointerTy()) {
+			CGERR_Invalid_Goto_Target(context);
+			CGERR_setLineNum(context, getLine(this), getFile(this));
+			CGERR_showAllMsg(context);
+			return CGValue();
+		}
+
+		// destinations are added once all label addresses of the function are known
+		indirect_br = context.builder->CreateIndirectBr(context.builder->CreatePointerCast(addr,
+														context.builder->getInt8PtrTy()));
+		context.addIndirectGoto(indirect_br);
+		setBlock(BasicBlock::Create(getGlobalContext(), "",
+									context.currentBlock()->getParent(),
+									context.current_end_block));
+
+		return CGValue(indirect_br);
+	}
 
 	if (!(dest_block = context.getLabel(label_name))) {
 		dest_block = BasicBlock::Create(getGlobalContext(), "",
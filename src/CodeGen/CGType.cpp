@@ -74,20 +74,7 @@ NType::getType(CodeGenContext& context)
 Type*
 NTypeof::getType(CodeGenContext& context)
 {
-	IRBuilderBase::InsertPoint backup = context.builder->saveIP();
-	bool is_lval = context.isLValue();
-	Value *tmp_val;
-
-	context.builder->SetInsertPoint(BasicBlock::Create(getGlobalContext())); // Set temp code container
-
-	context.resetLValue();
-	tmp_val = operand.codeGen(context);
-	if (is_lval) context.setLValue();
-
-	//delete context.builder->GetInsertBlock();
-	context.builder->restoreIP(backup);
-
-	return tmp_val->getType();
+	return operand.getExprType(context);
 }
 
 Type *
@@ -56,6 +56,12 @@ isConstant(Value *V)
 			|| iSConstantDataArray(V) || iSConstantExpr(V)
 			|| iSConstantPointerNull(V);
 }
+// signed overflow is undefined from int up, as in C after promotion
+inline bool
+hasNoSignedWrap(CodeGenContext& context, Type *T)
+{
+	return !context.arith.wrapv && T->getIntegerBitWidth() >= 32;
+}
 inline bool
 isFunctionPointer(Value *V)
 {
@@ -245,4 +251,11 @@ getAlignOfJIT(Type *T)
 	return getConstantIntExprJIT(ConstantExpr::getAlignOf(T));
 }
 
+// zero-sized member that raises the alignment of what follows it to align
+inline Type *
+getAlignFiller(unsigned align)
+{
+	return ArrayType::get(VectorType::get(Type::getInt8Ty(getGlobalContext()), align), 0);
+}
+
 #endif
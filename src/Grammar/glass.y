@@ -2,11 +2,14 @@
 	#include "AST/Node.h"
 	#include "AST/ASTErr.h"
 	#include "AST/Parser.h"
+	#include "CodeGen/CGStats.h"
     #include <cstdio>
     #include <cstdlib>
 	#include <cstring>
 	#include <map>
-	#define SETLINE(p) ((p)->lineno = current_line_number, (p)->file_name = current_file)
+	#include <typeinfo>
+	#define SETLINE(p) (compiler_stats.countNode((p), typeid(*(p)).name()), \
+						(p)->lineno = current_line_number, (p)->file_name = current_file)
 
 	extern Parser *main_parser;
 	extern CodeGenContext *global_context;
@@ -27,6 +30,39 @@
 		ASTERR_showAllMsgAndExit1();
 	}
 	int getAssignToBinary(int token);
+
+	AttributeSpecList *
+	mergeAttributes(AttributeSpecList *front, AttributeSpecList *back)
+	{
+		if (!front) {
+			return back;
+		}
+		if (back) {
+			front->insert(front->end(), back->begin(), back->end());
+			delete back;
+		}
+		return front;
+	}
+
+	void
+	setLoopHints(NStatement *loop, LoopHintList *loop_hints)
+	{
+		LoopHintList **dest;
+
+		if (typeid(*loop) == typeid(NWhileStatement)) {
+			dest = &((NWhileStatement *)loop)->loop_hints;
+		} else {
+			dest = &((NForStatement *)loop)->loop_hints;
+		}
+
+		if (*dest) { // several #pragma loop lines
+			(*dest)->insert((*dest)->begin(), loop_hints->begin(), loop_hints->end());
+			delete loop_hints;
+		} else {
+			*dest = loop_hints;
+		}
+		return;
+	}
 %}
 
 %union {
@@ -46,6 +82,10 @@
 	Declarator *declarator;
 	DeclaratorList *declarator_list;
 	NParamDecl *param_declaration;
+	NAttribute *attribute;
+	std::vector<NAttribute*> *attribute_list;
+	NLoopHint *loop_hint;
+	std::vector<NLoopHint*> *loop_hint_list;
 	std::string *string;
 	char character;
 	int token;
@@ -53,6 +93,7 @@
 }
 
 %token <string> TIDENTIFIER TTYPE_NAME TINTEGER TDOUBLE TSTRING TTRUE TFALSE
+%token <string> TLAZY_BLOCK
 %token <character> TCHAR
 %token <token> TCEQ TCNE TCLT TCLE TCGT TCGE TASSIGN
 %token <token> TLPAREN TRPAREN TLBRACE TRBRACE
@@ -62,8 +103,10 @@
 				TLNOT TNAMESPACE TDCOLON TINC TDEC TQUEM TFOR
 %token <token> TADD TSUB TMUL TDIV TMOD TSHR TSHL
 				TAADD TASUB TAMUL TADIV TAMOD TASHR TASHL TAAND TAOR TAXOR
-%token <token> TRETURN TEXTERN TDELEGATE TSTRUCT TSTATIC
-				TTYPEDEF TUNION TGOTO TBREAK TCONTINUE
+%token <token> TRETURN TEXTERN TDELEGATE TSTRUCT TSTATIC TATTRIBUTE
+				TTYPEDEF TUNION TGOTO TBREAK TCONTINUE TPRAGMA_LOOP
+				TLIKELY TUNLIKELY TBUILTIN_EXPECT TINLINE TALWAYS_INLINE
+				TSWITCH TCASE TDEFAULT TTAIL
 
 %type <identifier> identifier type_name namespace_header
 %type <expression> numeric string_literal expression
@@ -81,6 +124,10 @@
 %type <expression_list> expression_list
 %type <array_dim> array_dim
 %type <specifier> storage_specifier class_specifier prefix_specifier
+%type <attribute> attribute
+%type <attribute_list> attribute_list attribute_specifier attribute_specifier_opt
+%type <loop_hint> loop_hint
+%type <loop_hint_list> loop_hint_list
 %type <declaration_specifier> declaration_specifier
 %type <declarator> init_declarator declarator direct_declarator
 %type <declarator_list> declarator_list
@@ -102,11 +149,11 @@
 compile_unit
 	: external_declaration
 	{
-		main_parser->getAST()->statements.push_back($1);
+		main_parser->addStatement($1);
 	}
 	| compile_unit external_declaration
 	{
-		main_parser->getAST()->statements.push_back($2);
+		main_parser->addStatement($2);
 	}
 	;
 
@@ -191,6 +238,14 @@ storage_specifier
 	{
 		$$ = new NStaticSpecifier();
 	}
+	| TINLINE
+	{
+		$$ = new NInlineSpecifier(false);
+	}
+	| TALWAYS_INLINE
+	{
+		$$ = new NInlineSpecifier(true);
+	}
 	;
 
 class_specifier
@@ -203,6 +258,51 @@ class_specifier
 prefix_specifier
 	: storage_specifier
 	| class_specifier
+	| attribute_specifier
+	{
+		$$ = new NAttributeSpecifier(*$1);
+	}
+	;
+
+attribute
+	: identifier
+	{
+		$$ = new NAttribute(*new std::string($1->name), NULL);
+		delete $1;
+	}
+	| identifier TLPAREN expression_list TRPAREN
+	{
+		$$ = new NAttribute(*new std::string($1->name), $3);
+		delete $1;
+	}
+	;
+
+attribute_list
+	: attribute
+	{
+		$$ = new AttributeSpecList();
+		$$->push_back($1);
+	}
+	| attribute_list TCOMMA attribute
+	{
+		$1->push_back($3);
+		$$ = $1;
+	}
+	;
+
+attribute_specifier
+	: TATTRIBUTE TLPAREN TLPAREN attribute_list TRPAREN TRPAREN
+	{
+		$$ = $4;
+	}
+	;
+
+attribute_specifier_opt
+	: /* Blank */
+	{
+		$$ = NULL;
+	}
+	| attribute_specifier
 	;
 
 declaration_specifier
@@ -225,6 +325,17 @@ function_definition
 		$$ = new NFunctionDecl(*$1, *$2, $3);
 		SETLINE($$);
 	}
+	| declaration_specifier declarator TLAZY_BLOCK
+	{
+		extern int lazy_body_lineno;
+		NFunctionDecl *func_decl = new NFunctionDecl(*$1, *$2, NULL);
+
+		func_decl->lazy_body = $3;
+		func_decl->lazy_lineno = lazy_body_lineno;
+		func_decl->lazy_type_def = new std::map<std::string, int>(type_def); // later typedefs are not in scope
+		$$ = func_decl;
+		SETLINE($$);
+	}
 	;
 
 param_declaration
@@ -348,6 +459,12 @@ variable_declaration
 		$$ = new NVariableDecl(*$1, $2);
 		SETLINE($$);
 	}
+	| declaration_specifier declarator_list attribute_specifier
+	{
+		$1->push_back(new NAttributeSpecifier(*$3));
+		$$ = new NVariableDecl(*$1, $2);
+		SETLINE($$);
+	}
 	;
 
 delegate_declaration
@@ -423,47 +540,53 @@ fields_declaration
 	;*/
 
 struct_declaration
-	: TSTRUCT identifier TLBRACE
+	: TSTRUCT attribute_specifier_opt identifier TLBRACE
 	  fields_declaration
-	  TRBRACE
+	  TRBRACE attribute_specifier_opt
 	{
-		$$ = new NStructDecl(*$2, $4);
+		$$ = new NStructDecl(*$3, $5);
+		((NStructDecl *)$$)->attributes = mergeAttributes($2, $7);
 		SETLINE($$);
 	}
-	| TSTRUCT identifier
+	| TSTRUCT attribute_specifier_opt identifier
 	{
-		$$ = new NStructDecl(*$2, NULL);
+		$$ = new NStructDecl(*$3, NULL);
+		((NStructDecl *)$$)->attributes = $2;
 		SETLINE($$);
 	}
-	| TSTRUCT TLBRACE
+	| TSTRUCT attribute_specifier_opt TLBRACE
 	  fields_declaration
-	  TRBRACE
+	  TRBRACE attribute_specifier_opt
 	{
 		$$ = new NStructDecl(*new NIdentifier(*new std::string(".")),
-							 $3);
+							 $4);
+		((NStructDecl *)$$)->attributes = mergeAttributes($2, $6);
 		SETLINE($$);
 	}
 	;
 
 union_declaration
-	: TUNION identifier TLBRACE
+	: TUNION attribute_specifier_opt identifier TLBRACE
 	  fields_declaration
-	  TRBRACE
+	  TRBRACE attribute_specifier_opt
 	{
-		$$ = new NUnionDecl(*$2, $4);
+		$$ = new NUnionDecl(*$3, $5);
+		((NUnionDecl *)$$)->attributes = mergeAttributes($2, $7);
 		SETLINE($$);
 	}
-	| TUNION identifier
+	| TUNION attribute_specifier_opt identifier
 	{
-		$$ = new NUnionDecl(*$2, NULL);
+		$$ = new NUnionDecl(*$3, NULL);
+		((NUnionDecl *)$$)->attributes = $2;
 		SETLINE($$);
 	}
-	| TUNION TLBRACE
+	| TUNION attribute_specifier_opt TLBRACE
 	  fields_declaration
-	  TRBRACE
+	  TRBRACE attribute_specifier_opt
 	{
 		$$ = new NUnionDecl(*new NIdentifier(*new std::string(".")),
-							$3);
+							$4);
+		((NUnionDecl *)$$)->attributes = mergeAttributes($2, $6);
 		SETLINE($$);
 	}
 	;
@@ -605,6 +728,33 @@ iteration_statement
 		$$ = new NForStatement(*(NExpression*)$3, *(NExpression*)$4, *new NVoid(), $6);
 		SETLINE($$);
 	}
+	| TPRAGMA_LOOP loop_hint_list iteration_statement
+	{
+		setLoopHints($3, $2);
+		$$ = $3;
+	}
+	;
+
+loop_hint
+	: identifier TLPAREN assignment_expression TRPAREN
+	{
+		$$ = new NLoopHint(*new std::string($1->name), *$3);
+		SETLINE($$);
+		delete $1;
+	}
+	;
+
+loop_hint_list
+	: loop_hint
+	{
+		$$ = new LoopHintList();
+		$$->push_back($1);
+	}
+	| loop_hint_list loop_hint
+	{
+		$1->push_back($2);
+		$$ = $1;
+	}
 	;
 
 expression_statement
@@ -631,6 +781,11 @@ selection_statement
 		$$ = new NIfStatement(*$3, $5, $7);
 		SETLINE($$);
 	}
+	| TSWITCH TLPAREN expression TRPAREN statement
+	{
+		$$ = new NSwitchStatement(*$3, $5);
+		SETLINE($$);
+	}
 	;
 
 labeled_statement
@@ -640,6 +795,16 @@ labeled_statement
 		delete $1;
 		SETLINE($$);
 	}
+	| TCASE conditional_expression TCOLON statement
+	{
+		$$ = new NCaseStatement($2, *$4);
+		SETLINE($$);
+	}
+	| TDEFAULT TCOLON statement
+	{
+		$$ = new NCaseStatement(NULL, *$3);
+		SETLINE($$);
+	}
 	;
 
 jump_statement
@@ -649,6 +814,11 @@ jump_statement
 		delete $2;
 		SETLINE($$);
 	}
+	| TGOTO TMUL expression
+	{
+		$$ = new NGotoStatement(*$3);
+		SETLINE($$);
+	}
 	| TBREAK
 	{
 		$$ = new NJumpStatement(false);
@@ -681,6 +851,11 @@ ret_statement
 		$$ = new NReturnStatement(*$2);
 		SETLINE($$);
 	}
+	| TRETURN TTAIL postfix_expression
+	{
+		$$ = new NReturnStatement(*$3, true);
+		SETLINE($$);
+	}
 	| TRETURN
 	{
 		$$ = new NReturnStatement(*(new NVoid()));
@@ -852,6 +1027,27 @@ unary_expression
 		$$ = new NPrefixExpr($1, *$3);
 		SETLINE($$);
 	}
+	| TLAND identifier
+	{
+		$$ = new NLabelAddressExpr($2->name);
+		delete $2;
+		SETLINE($$);
+	}
+	| TLIKELY TLPAREN expression TRPAREN
+	{
+		$$ = new NExpectExpr(*$3, true);
+		SETLINE($$);
+	}
+	| TUNLIKELY TLPAREN expression TRPAREN
+	{
+		$$ = new NExpectExpr(*$3, false);
+		SETLINE($$);
+	}
+	| TBUILTIN_EXPECT TLPAREN assignment_expression TCOMMA assignment_expression TRPAREN
+	{
+		$$ = new NExpectExpr(*$3, *$5);
+		SETLINE($$);
+	}
 	;
 
 cast_expression
@@ -1,4 +1,9 @@
 #include "IOSetting.h"
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/IR/DiagnosticInfo.h>
+#include <llvm/IR/DiagnosticPrinter.h>
+#include <llvm/Support/Path.h>
 
 void
 IOSetting::initMap()
@@ -8,19 +13,66 @@ IOSetting::initMap()
 	ARG_MAP[ARG_TARGET_ASM] = TargetASM;
 	ARG_MAP[ARG_TARGET_IR] = TargetIR;
 	ARG_MAP[ARG_TARGET_EXE] = TargetExe;
+	ARG_MAP[ARG_STATS] = PrintStats;
+	ARG_MAP[ARG_STATS_JSON] = StatsJSON;
+	ARG_MAP[ARG_OPT_LEVEL_0] = OptLevel0;
+	ARG_MAP[ARG_OPT_LEVEL_1] = OptLevel1;
+	ARG_MAP[ARG_OPT_LEVEL_2] = OptLevel2;
+	ARG_MAP[ARG_OPT_LEVEL_3] = OptLevel3;
+	ARG_MAP[ARG_FUNC_REPORT] = FuncReport;
+	ARG_MAP[ARG_OPT_SIZE_BUDGET] = OptSizeBudget;
+	ARG_MAP[ARG_OPT_TIME_BUDGET] = OptTimeBudget;
+	ARG_MAP[ARG_STREAMING] = Streaming;
+	ARG_MAP[ARG_STREAMING_THREAD] = StreamingThread;
+	ARG_MAP[ARG_LAZY_PARSE] = LazyParse;
+	ARG_MAP[ARG_EMIT_PCH] = EmitPCH;
+	ARG_MAP[ARG_INCLUDE_PCH] = IncludePCH;
+	ARG_MAP[ARG_REMARK_PASSED] = RemarkPassed;
+	ARG_MAP[ARG_REMARK_MISSED] = RemarkMissed;
+	ARG_MAP[ARG_REMARK_ANALYSIS] = RemarkAnalysis;
+	ARG_MAP[ARG_REMARKS_YAML] = RemarksYAML;
+	ARG_MAP[ARG_DEBUG] = DebugInfo;
+	ARG_MAP[ARG_DEBUG_LINE_TABLES] = DebugLineTables;
+	ARG_MAP[ARG_PROFILE_GENERATE] = ProfileGenerate;
+	ARG_MAP[ARG_PROFILE_GENERATE_FILE] = ProfileGenerateFile;
+	ARG_MAP[ARG_PROFILE_USE] = ProfileUse;
+	ARG_MAP[ARG_INSTRUMENT_FUNCTIONS] = InstrumentFunctions;
+	ARG_MAP[ARG_FAST_MATH] = FastMath;
+	ARG_MAP[ARG_FP_CONTRACT] = FPContract;
+	ARG_MAP[ARG_WRAPV] = Wrapv;
+	ARG_MAP[ARG_COMMON] = Common;
+	ARG_MAP[ARG_NO_COMMON] = NoCommon;
+	ARG_MAP[ARG_VISIBILITY] = Visibility;
 	return;
 }
 
 IOSetting::ArgumentType
 IOSetting::getArg(char *arg)
 {
+	char *value;
+
 	if (ARG_MAP.find(arg) != ARG_MAP.end()) {
 		return ARG_MAP[arg];
 	}
 
+	// "-option=value" is registered as "-option="
+	if ((value = getArgValue(arg)) != NULL) {
+		string prefix(arg, value - arg);
+		if (ARG_MAP.find(prefix) != ARG_MAP.end()) {
+			return ARG_MAP[prefix];
+		}
+	}
+
 	return Unknown;
 }
 
+char *
+IOSetting::getArgValue(char *arg)
+{
+	char *equal_sign = strchr(arg, '=');
+	return equal_sign ? equal_sign + 1 : NULL;
+}
+
 string
 IOSetting::getRandomString(int length)
 {
@@ -88,18 +140,238 @@ IOSetting::applySetting()
 {
 	extern char *current_file;
 	extern FILE *yyin;
+	extern CodeGenContext *global_context;
 	if (hasInput()) {
 		current_file = strdup(input_file.c_str());
-		yyin = fopen(doPreprocess(input_file).c_str(), "r");
+		yyin = openSource(doPreprocess(input_file));
 		if (!yyin) {
 			ErrorMessage::tmpError("Cannot find source file: " + input_file);
 		}
+		if (streaming) {
+			main_parser->setStreaming(global_context, streaming_thread);
+		}
+		// deferred bodies of header functions could not be precompiled
+		main_parser->setLazyParse(lazy_parse && emit_pch_file.empty());
+		setupRemarks();
+		if (debug_info) {
+			global_context->initDebugInfo(input_file, opt_level > 0);
+		}
+		global_context->profile_output = profile_generate_file;
+		global_context->profile_unit = input_file;
+		global_context->instrument_functions = instrument_functions;
+		global_context->default_arith = arith_mode;
+		global_context->setArithmeticMode(arith_mode);
+		global_context->common_globals = common_globals;
+		if (visibility == "hidden") {
+			global_context->default_visibility = GlobalValue::HiddenVisibility;
+		} else if (visibility == "protected") {
+			global_context->default_visibility = GlobalValue::ProtectedVisibility;
+		} else if (visibility != "default") {
+			ErrorMessage::tmpError("Unknown visibility: " + visibility);
+			delete this;
+			exit(1);
+		}
+		if (!profile_use_file.empty()
+			&& !global_context->loadProfile(profile_use_file)) {
+			ErrorMessage::tmpError("Cannot read profile: " + profile_use_file);
+			delete this;
+			exit(1);
+		}
 	} else {
 		delete this;
 		exit(0);
 	}
 }
 
+static string
+quoteYAML(StringRef str)
+{
+	string ret = "'";
+	size_t i;
+
+	for (i = 0; i < str.size(); i++) {
+		if (str[i] == '\'') {
+			ret += "''";
+		} else if (str[i] == '\n') {
+			ret += ' ';
+		} else {
+			ret += str[i];
+		}
+	}
+
+	return ret + "'";
+}
+
+static void
+handleDiagnostic(const DiagnosticInfo& diag, void *ctx)
+{
+	extern CodeGenContext *global_context;
+	RemarkFilter *filter = (RemarkFilter *)ctx;
+	const DiagnosticInfoOptimizationRemarkBase *remark;
+	std::map<std::string, SourceLocation>::const_iterator loc_it;
+	Regex *pattern;
+	const char *kind;
+	StringRef file_name;
+	unsigned lineno = 0;
+	unsigned column = 0;
+
+	switch (diag.getKind()) {
+		case DK_OptimizationRemark:
+			kind = "Passed";
+			pattern = filter->passed;
+			break;
+		case DK_OptimizationRemarkMissed:
+			kind = "Missed";
+			pattern = filter->missed;
+			break;
+		case DK_OptimizationRemarkAnalysis:
+			kind = "Analysis";
+			pattern = filter->analysis;
+			break;
+		default: // what LLVM would print without a handler
+		{
+			DiagnosticPrinterRawOStream printer(errs());
+			diag.print(printer);
+			errs() << "\n";
+			if (diag.getSeverity() == DS_Error) {
+				exit(1);
+			}
+			return;
+		}
+	}
+
+	remark = cast<DiagnosticInfoOptimizationRemarkBase>(&diag);
+	if (!pattern || !pattern->match(remark->getPassName())) {
+		return;
+	}
+
+	// debug locations if there are any, else where the function was defined
+	if (remark->isLocationAvailable()) {
+		remark->getLocation(&file_name, &lineno, &column);
+	} else if ((loc_it = global_context->function_locations.find(remark->getFunction().getName().str()))
+			   != global_context->function_locations.end()) {
+		file_name = loc_it->second.file_name ? loc_it->second.file_name : "";
+		lineno = loc_it->second.lineno;
+	}
+
+	if (filter->yaml) {
+		*filter->yaml << "--- !" << kind << "\n"
+					  << "Pass:            " << quoteYAML(remark->getPassName()) << "\n"
+					  << "DebugLoc:        { File: " << quoteYAML(file_name)
+					  << ", Line: " << lineno << ", Column: " << column << " }\n"
+					  << "Function:        " << quoteYAML(remark->getFunction().getName()) << "\n"
+					  << "Args:\n"
+					  << "  - String:      " << quoteYAML(remark->getMsg()) << "\n"
+					  << "...\n";
+	} else {
+		cerr << file_name.str() << ":" << lineno << ": remark: "
+			 << remark->getMsg().str() << " [-Rpass"
+			 << (diag.getKind() == DK_OptimizationRemarkMissed ? "-missed" :
+				 diag.getKind() == DK_OptimizationRemarkAnalysis ? "-analysis" : "")
+			 << "=" << remark->getPassName() << "] (in " << remark->getFunction().getName().str() << ")"
+			 << endl;
+	}
+
+	return;
+}
+
+void
+IOSetting::setupRemarks()
+{
+	string error;
+
+	if (!remarks.enabled()) {
+		return;
+	}
+
+	if ((remarks.passed && !remarks.passed->isValid(error))
+		|| (remarks.missed && !remarks.missed->isValid(error))
+		|| (remarks.analysis && !remarks.analysis->isValid(error))) {
+		ErrorMessage::tmpError("Invalid -Rpass pattern: " + error);
+		delete this;
+		exit(1);
+	}
+
+	if (!remarks_yaml_file.empty()) {
+		remarks.yaml = new ofstream(remarks_yaml_file.c_str());
+		if (!*remarks.yaml) {
+			ErrorMessage::tmpError("Cannot open remarks file: " + remarks_yaml_file);
+			delete this;
+			exit(1);
+		}
+	}
+
+	// filtered by handleDiagnostic itself
+	getGlobalContext().setDiagnosticHandler(handleDiagnostic, &remarks, false);
+
+	return;
+}
+
+// with a precompiled header the parser starts right after the #include prefix;
+// when emitting one it only sees that prefix
+FILE *
+IOSetting::openSource(string preprocessed_path)
+{
+	extern CodeGenContext *global_context;
+	FILE *fp;
+	string prefix_path;
+
+	if (emit_pch_file.empty() && include_pch_file.empty()) {
+		return fopen(preprocessed_path.c_str(), "r");
+	}
+
+	if (!pch_prefix.scan(preprocessed_path)) {
+		if (!emit_pch_file.empty()) {
+			ErrorMessage::tmpError("No #include prefix to precompile in " + input_file);
+			delete this;
+			exit(1);
+		}
+		return fopen(preprocessed_path.c_str(), "r");
+	}
+
+	if (!emit_pch_file.empty()) {
+		FILE *src = fopen(preprocessed_path.c_str(), "r");
+		char *buffer = new char[pch_prefix.length];
+
+		prefix_path = getTempFilePath();
+		tmp_file_paths->push_back(prefix_path);
+		fp = fopen(prefix_path.c_str(), "w");
+		if (!src || !fp
+			|| fread(buffer, 1, pch_prefix.length, src) != pch_prefix.length
+			|| fwrite(buffer, 1, pch_prefix.length, fp) != pch_prefix.length) {
+			ErrorMessage::tmpError("Cannot write header prefix of " + input_file);
+			delete this;
+			exit(1);
+		}
+		delete[] buffer;
+		fclose(src);
+		fclose(fp);
+
+		return fopen(prefix_path.c_str(), "r");
+	}
+
+	fp = fopen(preprocessed_path.c_str(), "r");
+	if (fp && PrecompiledHeader::load(*global_context, pch_prefix, include_pch_file)) {
+		fseek(fp, pch_prefix.length, SEEK_SET);
+	}
+
+	return fp;
+}
+
+void
+IOSetting::doEmitPCH(CodeGenContext& context, NBlock& AST)
+{
+	AST.codeGen(context);
+
+	if (!PrecompiledHeader::emit(context, pch_prefix, emit_pch_file)) {
+		delete this;
+		exit(1);
+	}
+
+	delete this;
+	exit(0);
+}
+
 bool
 IOSetting::hasInput()
 {
@@ -142,6 +414,12 @@ IOSetting::targetExe()
 	return target_exe;
 }
 
+bool
+IOSetting::isPCHOutput()
+{
+	return !emit_pch_file.empty();
+}
+
 bool
 IOSetting::isIROutput()
 {
@@ -166,6 +444,77 @@ IOSetting::getFilePath(string file)
 	return file.substr(0, file.length() - string(basename(file.c_str())).length());
 }
 
+void
+IOSetting::doOptimize(Module *mod)
+{
+	PassManagerBuilder builder;
+	FunctionPassManager func_pm(mod);
+	PassManager module_pm;
+	Module::iterator func_it;
+	Function::const_iterator block_it;
+	uint64_t inst_count;
+	double total_opt_time = 0.0;
+	clock_t start_time;
+
+	if (!opt_level) {
+		return;
+	}
+
+	builder.OptLevel = opt_level;
+	if (opt_level > 1) {
+		builder.Inliner = createFunctionInliningPass(opt_level, 0);
+	} else {
+		builder.Inliner = createAlwaysInlinerPass();
+	}
+	builder.populateFunctionPassManager(func_pm);
+	builder.populateModulePassManager(module_pm);
+
+	// run the function-level pipeline one function at a time so its cost can be
+	// attributed and functions over budget can be left at -O0
+	func_pm.doInitialization();
+	for (func_it = mod->begin(); func_it != mod->end(); func_it++) {
+		if (func_it->isDeclaration()) {
+			continue;
+		}
+
+		inst_count = 0;
+		for (block_it = func_it->begin(); block_it != func_it->end(); block_it++) {
+			inst_count += block_it->size();
+		}
+
+		if ((opt_size_budget && inst_count > opt_size_budget)
+			|| (opt_time_budget && total_opt_time * 1000 > opt_time_budget)) {
+			// the module pipeline skips optnone functions as well;
+			// optnone needs noinline, which conflicts with always_inline
+			func_it->removeFnAttr(Attribute::AlwaysInline);
+			func_it->addFnAttr(Attribute::OptimizeNone);
+			func_it->addFnAttr(Attribute::NoInline);
+			if (compiler_stats.track_costs) {
+				compiler_stats.getCost(func_it->getName().str()).opt_skipped = true;
+			}
+			continue;
+		}
+
+		start_time = clock();
+		func_pm.run(*func_it);
+		total_opt_time += (double)(clock() - start_time) / CLOCKS_PER_SEC;
+
+		if (compiler_stats.track_costs) {
+			compiler_stats.getCost(func_it->getName().str()).opt_time
+				+= (double)(clock() - start_time) / CLOCKS_PER_SEC;
+		}
+	}
+	func_pm.doFinalization();
+
+	start_time = clock();
+	module_pm.run(*mod);
+	if (compiler_stats.track_costs) {
+		compiler_stats.module_opt_time += (double)(clock() - start_time) / CLOCKS_PER_SEC;
+	}
+
+	return;
+}
+
 void
 IOSetting::doOutput(Module *mod)
 {
@@ -208,6 +557,12 @@ IOSetting::doOutput(Module *mod)
 			return;
 		}
 		TargetOptions target_options;
+		target_options.UnsafeFPMath = arith_mode.fast_math;
+		target_options.NoInfsFPMath = arith_mode.fast_math;
+		target_options.NoNaNsFPMath = arith_mode.fast_math;
+		if (fp_contract_fast || arith_mode.fast_math) {
+			target_options.AllowFPOpFusion = FPOpFusion::Fast;
+		}
 		TargetMachine *target_machine = target->createTargetMachine(
 									   sys::getDefaultTargetTriple(),
 									   sys::getHostCPUName(), "",
@@ -245,12 +600,21 @@ IOSetting::doOutput(Module *mod)
 		ouput_tool.keep();
 	}
 
+	if ((targetObj() || targetExe()) && compiler_stats.track_costs) {
+		compiler_stats.readObjectSizes(tmp_output_name);
+	}
+
 	if (targetExe()) {
 		cout << getObject() << endl;
 		string cmd = "gcc " + tmp_output_name + " -o "
 					 + (getObject().empty()
 						? "a.out"
 						: getObject());
+		if (instrument_functions) { // the JIT finds the runtime in the compiler itself
+			cmd += " " + sys::path::parent_path(sys::fs::getMainExecutable(program_path.c_str(),
+																		   (void *)&isFileExist)).str()
+				   + "/" + PROFILER_RUNTIME_PATH + " -lpthread";
+		}
 		tmp_file_paths->push_back(tmp_output_name);
 		int status = system(cmd.c_str());
 
@@ -264,3 +628,26 @@ IOSetting::doOutput(Module *mod)
 		}
 	}
 }
+
+void
+IOSetting::doStatsOutput()
+{
+	if (func_report_count) {
+		compiler_stats.printCostReport(cerr, func_report_count);
+	}
+
+	if (print_stats) {
+		compiler_stats.printText(cerr);
+	}
+
+	if (!stats_json_file.empty()) {
+		ofstream json_file(stats_json_file.c_str());
+		if (!json_file) {
+			cerr << "Cannot open stats file: " << stats_json_file << endl;
+			return;
+		}
+		compiler_stats.printJSON(json_file);
+	}
+
+	return;
+}
@@ -8,6 +8,8 @@
 #include <stdlib.h>
 #include <time.h>
 #include "../CodeGen/CGAST.h"
+#include "../AST/Parser.h"
+#include "../CodeGen/CGPCH.h"
 #include <llvm/Support/ManagedStatic.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/raw_ostream.h>
@@ -18,12 +20,48 @@
 #include <llvm/Support/Host.h>
 #include <llvm/Support/TargetRegistry.h>
 #include <llvm/Support/CommandLine.h>
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Support/Regex.h>
 
 #define ARG_OBJECT ("-o")
 #define ARG_TARGET_OBJECT ("-c")
 #define ARG_TARGET_ASM ("-s")
 #define ARG_TARGET_IR ("-S")
 #define ARG_TARGET_EXE ("-e")
+#define ARG_STATS ("-stats")
+#define ARG_STATS_JSON ("-stats-json")
+#define ARG_OPT_LEVEL_0 ("-O0")
+#define ARG_OPT_LEVEL_1 ("-O1")
+#define ARG_OPT_LEVEL_2 ("-O2")
+#define ARG_OPT_LEVEL_3 ("-O3")
+#define ARG_FUNC_REPORT ("-func-report")
+#define ARG_OPT_SIZE_BUDGET ("-fopt-size-budget=")
+#define ARG_OPT_TIME_BUDGET ("-fopt-time-budget=")
+#define ARG_STREAMING ("-fstreaming")
+#define ARG_STREAMING_THREAD ("-fstreaming-thread")
+#define ARG_LAZY_PARSE ("-flazy-parse")
+#define ARG_EMIT_PCH ("-emit-pch")
+#define ARG_INCLUDE_PCH ("-include-pch")
+#define ARG_REMARK_PASSED ("-Rpass=")
+#define ARG_REMARK_MISSED ("-Rpass-missed=")
+#define ARG_REMARK_ANALYSIS ("-Rpass-analysis=")
+#define ARG_REMARKS_YAML ("-remarks-yaml")
+#define ARG_DEBUG ("-g")
+#define ARG_DEBUG_LINE_TABLES ("-gline-tables-only")
+#define ARG_PROFILE_GENERATE ("-fprofile-generate")
+#define ARG_PROFILE_GENERATE_FILE ("-fprofile-generate=")
+#define ARG_PROFILE_USE ("-fprofile-use=")
+
+#define ARG_INSTRUMENT_FUNCTIONS ("-finstrument-functions")
+#define ARG_FAST_MATH ("-ffast-math")
+#define ARG_FP_CONTRACT ("-ffp-contract=")
+#define ARG_WRAPV ("-fwrapv")
+#define ARG_COMMON ("-fcommon")
+#define ARG_NO_COMMON ("-fno-common")
+#define ARG_VISIBILITY ("-fvisibility=")
+
+#define PROFILE_DEFAULT_OUTPUT ("default.phiprof")
+#define PROFILER_RUNTIME_PATH ("Lib/runtime/libphiprof.a") // next to the compiler
 
 using namespace std;
 using namespace llvm;
@@ -41,6 +79,28 @@ isFileExist(string path)
 	return true;
 }
 
+// optimization remarks selected by -Rpass*, printed as text or YAML
+class RemarkFilter {
+public:
+	Regex *passed = NULL;
+	Regex *missed = NULL;
+	Regex *analysis = NULL;
+	ofstream *yaml = NULL;
+
+	bool enabled()
+	{
+		return passed || missed || analysis;
+	}
+
+	~RemarkFilter()
+	{
+		delete passed;
+		delete missed;
+		delete analysis;
+		delete yaml;
+	}
+};
+
 class IOSetting
 {
 	bool target_asm = false;
@@ -49,6 +109,29 @@ class IOSetting
 	bool target_exe = false;
 	string input_file = "";
 	string object_file = "";
+	bool print_stats = false;
+	string stats_json_file = "";
+	unsigned opt_level = 0;
+	unsigned func_report_count = 0;
+	uint64_t opt_size_budget = 0; // IR instructions, 0 for unlimited
+	double opt_time_budget = 0.0; // milliseconds, 0 for unlimited
+	bool streaming = false;
+	bool streaming_thread = false;
+	bool lazy_parse = false;
+	string emit_pch_file = "";
+	string include_pch_file = "";
+	PCHPrefix pch_prefix;
+	RemarkFilter remarks;
+	string remarks_yaml_file = "";
+	bool debug_info = false;
+	string profile_generate_file = "";
+	string profile_use_file = "";
+	bool instrument_functions = false;
+	string program_path = "";
+	ArithmeticMode arith_mode;
+	bool fp_contract_fast = false; // also across expressions, by the backend
+	bool common_globals = false;
+	string visibility = "default";
 
 public:
 
@@ -58,7 +141,37 @@ public:
 		TargetObj,
 		TargetASM,
 		TargetIR,
-		TargetExe
+		TargetExe,
+		PrintStats,
+		StatsJSON,
+		OptLevel0,
+		OptLevel1,
+		OptLevel2,
+		OptLevel3,
+		FuncReport,
+		OptSizeBudget,
+		OptTimeBudget,
+		Streaming,
+		StreamingThread,
+		LazyParse,
+		EmitPCH,
+		IncludePCH,
+		RemarkPassed,
+		RemarkMissed,
+		RemarkAnalysis,
+		RemarksYAML,
+		DebugInfo,
+		DebugLineTables,
+		ProfileGenerate,
+		ProfileGenerateFile,
+		ProfileUse,
+		InstrumentFunctions,
+		FastMath,
+		FPContract,
+		Wrapv,
+		Common,
+		NoCommon,
+		Visibility
 	};
 	std::map<std::string, ArgumentType> ARG_MAP;
 
@@ -69,6 +182,7 @@ public:
 		int i;
 
 		initMap();
+		program_path = argv[0];
 		for (i = 1; i < argc; i++) {
 			switch (getArg(argv[i])) {
 				case ObjectFile:
@@ -87,11 +201,108 @@ public:
 				case TargetExe:
 					target_exe = true;
 					break;
+				case PrintStats:
+					print_stats = true;
+					break;
+				case StatsJSON:
+					stats_json_file = argv[i + 1];
+					i++;
+					break;
+				case OptLevel0:
+				case OptLevel1:
+				case OptLevel2:
+				case OptLevel3:
+					opt_level = getArg(argv[i]) - OptLevel0;
+					break;
+				case FuncReport:
+					func_report_count = atoi(argv[i + 1]);
+					i++;
+					break;
+				case OptSizeBudget:
+					opt_size_budget = strtoull(getArgValue(argv[i]), NULL, 10);
+					break;
+				case OptTimeBudget:
+					opt_time_budget = atof(getArgValue(argv[i]));
+					break;
+				case Streaming:
+					streaming = true;
+					break;
+				case StreamingThread:
+					streaming = true;
+					streaming_thread = true;
+					break;
+				case LazyParse:
+					lazy_parse = true;
+					break;
+				case EmitPCH:
+					emit_pch_file = argv[i + 1];
+					i++;
+					break;
+				case IncludePCH:
+					include_pch_file = argv[i + 1];
+					i++;
+					break;
+				case RemarkPassed:
+					remarks.passed = new Regex(getArgValue(argv[i]));
+					break;
+				case RemarkMissed:
+					remarks.missed = new Regex(getArgValue(argv[i]));
+					break;
+				case RemarkAnalysis:
+					remarks.analysis = new Regex(getArgValue(argv[i]));
+					break;
+				case RemarksYAML:
+					remarks_yaml_file = argv[i + 1];
+					i++;
+					break;
+				case DebugInfo:
+				case DebugLineTables: // only line tables are emitted either way
+					debug_info = true;
+					break;
+				case ProfileGenerate:
+					profile_generate_file = PROFILE_DEFAULT_OUTPUT;
+					break;
+				case ProfileGenerateFile:
+					profile_generate_file = getArgValue(argv[i]);
+					break;
+				case ProfileUse:
+					profile_use_file = getArgValue(argv[i]);
+					break;
+				case InstrumentFunctions:
+					instrument_functions = true;
+					break;
+				case FastMath:
+					arith_mode.fast_math = true;
+					break;
+				case FPContract: // fast, on or off
+					arith_mode.fp_contract = strcmp(getArgValue(argv[i]), "off") != 0;
+					fp_contract_fast = !strcmp(getArgValue(argv[i]), "fast");
+					break;
+				case Wrapv:
+					arith_mode.wrapv = true;
+					break;
+				case Common:
+					common_globals = true;
+					break;
+				case NoCommon:
+					common_globals = false;
+					break;
+				case Visibility:
+					visibility = getArgValue(argv[i]);
+					break;
 				default: // input file
 					input_file = argv[i];
 					break;
 			}
 		}
+
+		if (print_stats || !stats_json_file.empty()) {
+			compiler_stats.enabled = true;
+			EnableStatistics();
+		}
+		if (func_report_count) {
+			compiler_stats.track_costs = true;
+		}
 	}
 
 	virtual ~IOSetting()
@@ -106,6 +317,7 @@ public:
 	}
 
 	ArgumentType getArg(char *arg);
+	char *getArgValue(char *arg);
 
 	string getRandomString(int length);
 
@@ -123,11 +335,17 @@ public:
 	bool targetIR();
 	bool targetExe();
 	bool isIROutput();
+	bool isPCHOutput();
 
 	string getFileName(string file);
 	string getFilePath(string file);
 
+	FILE *openSource(string preprocessed_path);
+	void setupRemarks();
+	void doEmitPCH(CodeGenContext& context, NBlock& AST);
+	void doOptimize(Module *mod);
 	void doOutput(Module *mod);
+	void doStatsOutput();
 };
 
 #endif
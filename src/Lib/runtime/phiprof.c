@@ -0,0 +1,376 @@
+/*
+ * Flat profiler for programs compiled with -finstrument-functions.
+ *
+ * The compiler calls __phi_func_enter/__phi_func_exit with the name of
+ * the function, a private string per function, so names are compared by
+ * address. Each thread keeps its own shadow stack and tables; they are
+ * merged when the process exits and written to $PHIPROF_OUT (phiprof.out
+ * by default, "-" for stderr) as a flat profile sorted by self time and
+ * a caller/callee summary.
+ *
+ * Times are TSC cycles on x86, nanoseconds elsewhere.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#define PHIPROF_MAX_DEPTH 4096
+#define PHIPROF_INIT_SIZE 256 /* power of 2 */
+
+typedef struct {
+	const char *name;
+	uint64_t calls;
+	uint64_t self;
+	uint64_t total; /* outermost activations only */
+	unsigned active;
+} phi_func_stat;
+
+typedef struct {
+	const char *caller;
+	const char *callee;
+	uint64_t calls;
+	uint64_t total;
+} phi_edge_stat;
+
+typedef struct {
+	const char *name;
+	uint64_t start;
+	uint64_t children;
+	phi_func_stat *stat;
+} phi_frame;
+
+typedef struct phi_thread {
+	phi_frame stack[PHIPROF_MAX_DEPTH];
+	unsigned depth;
+	unsigned lost; /* frames deeper than the shadow stack */
+	phi_func_stat *funcs;
+	unsigned func_count;
+	unsigned func_size;
+	phi_edge_stat *edges;
+	unsigned edge_count;
+	unsigned edge_size;
+	struct phi_thread *next;
+} phi_thread;
+
+static __thread phi_thread *self_thread = NULL;
+static phi_thread *all_threads = NULL;
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline uint64_t
+phi_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	uint32_t lo, hi;
+
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t)hi << 32) | lo;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline unsigned
+phi_hash(const void *a, const void *b)
+{
+	uintptr_t key = (uintptr_t)a * 31 + (uintptr_t)b;
+
+	return (unsigned)((key >> 4) ^ (key >> 16));
+}
+
+static phi_func_stat *
+phi_find_func(phi_thread *thread, const char *name)
+{
+	phi_func_stat *old_funcs;
+	unsigned old_size;
+	unsigned i, j;
+
+	if ((thread->func_count + 1) * 2 > thread->func_size) { /* keep it half empty */
+		old_funcs = thread->funcs;
+		old_size = thread->func_size;
+		thread->func_size = old_size ? old_size * 2 : PHIPROF_INIT_SIZE;
+		thread->funcs = calloc(thread->func_size, sizeof(phi_func_stat));
+		for (i = 0; i < old_size; i++) {
+			if (!old_funcs[i].name) {
+				continue;
+			}
+			j = phi_hash(old_funcs[i].name, NULL) & (thread->func_size - 1);
+			while (thread->funcs[j].name) {
+				j = (j + 1) & (thread->func_size - 1);
+			}
+			thread->funcs[j] = old_funcs[i];
+		}
+		free(old_funcs);
+
+		/* frames point into the table */
+		for (i = 0; i < thread->depth; i++) {
+			thread->stack[i].stat = NULL;
+		}
+	}
+
+	i = phi_hash(name, NULL) & (thread->func_size - 1);
+	while (thread->funcs[i].name && thread->funcs[i].name != name) {
+		i = (i + 1) & (thread->func_size - 1);
+	}
+	if (!thread->funcs[i].name) {
+		thread->funcs[i].name = name;
+		thread->func_count++;
+	}
+
+	return &thread->funcs[i];
+}
+
+static phi_edge_stat *
+phi_find_edge(phi_thread *thread, const char *caller, const char *callee)
+{
+	phi_edge_stat *old_edges;
+	unsigned old_size;
+	unsigned i, j;
+
+	if ((thread->edge_count + 1) * 2 > thread->edge_size) {
+		old_edges = thread->edges;
+		old_size = thread->edge_size;
+		thread->edge_size = old_size ? old_size * 2 : PHIPROF_INIT_SIZE;
+		thread->edges = calloc(thread->edge_size, sizeof(phi_edge_stat));
+		for (i = 0; i < old_size; i++) {
+			if (!old_edges[i].callee) {
+				continue;
+			}
+			j = phi_hash(old_edges[i].caller, old_edges[i].callee) & (thread->edge_size - 1);
+			while (thread->edges[j].callee) {
+				j = (j + 1) & (thread->edge_size - 1);
+			}
+			thread->edges[j] = old_edges[i];
+		}
+		free(old_edges);
+	}
+
+	i = phi_hash(caller, callee) & (thread->edge_size - 1);
+	while (thread->edges[i].callee
+		   && (thread->edges[i].caller != caller || thread->edges[i].callee != callee)) {
+		i = (i + 1) & (thread->edge_size - 1);
+	}
+	if (!thread->edges[i].callee) {
+		thread->edges[i].caller = caller;
+		thread->edges[i].callee = callee;
+		thread->edge_count++;
+	}
+
+	return &thread->edges[i];
+}
+
+static void phi_dump(void);
+
+static phi_thread *
+phi_register_thread(void)
+{
+	phi_thread *thread = calloc(1, sizeof(phi_thread));
+
+	pthread_mutex_lock(&threads_lock);
+	if (!all_threads) {
+		atexit(phi_dump);
+	}
+	thread->next = all_threads;
+	all_threads = thread;
+	pthread_mutex_unlock(&threads_lock);
+
+	return thread;
+}
+
+void
+__phi_func_enter(const char *name)
+{
+	phi_thread *thread = self_thread;
+	phi_frame *frame;
+
+	if (!thread) {
+		thread = self_thread = phi_register_thread();
+	}
+
+	if (thread->depth == PHIPROF_MAX_DEPTH) {
+		thread->lost++;
+		return;
+	}
+
+	frame = &thread->stack[thread->depth++];
+	frame->name = name;
+	frame->children = 0;
+	frame->stat = phi_find_func(thread, name);
+	frame->stat->calls++;
+	frame->stat->active++;
+	frame->start = phi_now(); /* last, so the bookkeeping above is not charged */
+
+	return;
+}
+
+static void
+phi_pop_frame(phi_thread *thread, uint64_t end)
+{
+	phi_frame *frame = &thread->stack[--thread->depth];
+	phi_edge_stat *edge;
+	uint64_t elapsed = end - frame->start;
+
+	if (!frame->stat) {
+		frame->stat = phi_find_func(thread, frame->name);
+	}
+	frame->stat->self += elapsed - frame->children;
+	if (!--frame->stat->active) {
+		frame->stat->total += elapsed;
+	}
+
+	if (thread->depth) {
+		thread->stack[thread->depth - 1].children += elapsed;
+		edge = phi_find_edge(thread, thread->stack[thread->depth - 1].name, frame->name);
+	} else {
+		edge = phi_find_edge(thread, NULL, frame->name);
+	}
+	edge->calls++;
+	edge->total += elapsed;
+
+	return;
+}
+
+void
+__phi_func_exit(const char *name)
+{
+	uint64_t end = phi_now();
+	phi_thread *thread = self_thread;
+
+	if (!thread || !thread->depth) {
+		return;
+	}
+	if (thread->lost) {
+		thread->lost--;
+		return;
+	}
+
+	/* frames left through longjmp are closed here as well */
+	while (thread->depth && thread->stack[thread->depth - 1].name != name) {
+		phi_pop_frame(thread, end);
+	}
+	if (thread->depth) {
+		phi_pop_frame(thread, end);
+	}
+
+	return;
+}
+
+static int
+phi_compare_self(const void *a, const void *b)
+{
+	const phi_func_stat *lhs = a;
+	const phi_func_stat *rhs = b;
+
+	if (lhs->self != rhs->self) {
+		return lhs->self < rhs->self ? 1 : -1;
+	}
+	return strcmp(lhs->name, rhs->name);
+}
+
+static void
+phi_dump(void)
+{
+	phi_thread *merged = calloc(1, sizeof(phi_thread));
+	phi_thread *thread;
+	phi_func_stat *stat;
+	phi_func_stat *sorted;
+	phi_edge_stat *edge;
+	const char *path = getenv("PHIPROF_OUT");
+	uint64_t now = phi_now();
+	uint64_t all_self = 0;
+	unsigned count = 0;
+	unsigned i, j;
+	FILE *fp;
+
+	pthread_mutex_lock(&threads_lock);
+	for (thread = all_threads; thread; thread = thread->next) {
+		/* functions still running, e.g. main when exit() is called */
+		while (thread->depth) {
+			phi_pop_frame(thread, now);
+		}
+		for (i = 0; i < thread->func_size; i++) {
+			if (thread->funcs[i].name) {
+				stat = phi_find_func(merged, thread->funcs[i].name);
+				stat->calls += thread->funcs[i].calls;
+				stat->self += thread->funcs[i].self;
+				stat->total += thread->funcs[i].total;
+			}
+		}
+		for (i = 0; i < thread->edge_size; i++) {
+			if (thread->edges[i].callee) {
+				edge = phi_find_edge(merged, thread->edges[i].caller, thread->edges[i].callee);
+				edge->calls += thread->edges[i].calls;
+				edge->total += thread->edges[i].total;
+			}
+		}
+	}
+	pthread_mutex_unlock(&threads_lock);
+
+	if (!path || !*path) {
+		path = "phiprof.out";
+	}
+	fp = strcmp(path, "-") ? fopen(path, "w") : stderr;
+	if (!fp) {
+		return;
+	}
+
+	sorted = calloc(merged->func_count + 1, sizeof(phi_func_stat));
+	for (i = 0; i < merged->func_size; i++) {
+		if (merged->funcs[i].name) {
+			sorted[count++] = merged->funcs[i];
+			all_self += merged->funcs[i].self;
+		}
+	}
+	qsort(sorted, count, sizeof(phi_func_stat), phi_compare_self);
+
+	fprintf(fp, "Flat profile (%s):\n\n",
+#if defined(__x86_64__) || defined(__i386__)
+			"cycles"
+#else
+			"nanoseconds"
+#endif
+			);
+	fprintf(fp, "%7s %16s %16s %12s %14s %14s  %s\n",
+			"%self", "self", "total", "calls", "self/call", "total/call", "name");
+	for (i = 0; i < count; i++) {
+		fprintf(fp, "%7.2f %16llu %16llu %12llu %14llu %14llu  %s\n",
+				all_self ? 100.0 * sorted[i].self / all_self : 0.0,
+				(unsigned long long)sorted[i].self, (unsigned long long)sorted[i].total,
+				(unsigned long long)sorted[i].calls,
+				(unsigned long long)(sorted[i].calls ? sorted[i].self / sorted[i].calls : 0),
+				(unsigned long long)(sorted[i].calls ? sorted[i].total / sorted[i].calls : 0),
+				sorted[i].name);
+	}
+
+	fprintf(fp, "\nCall graph (calls and total time of each edge):\n");
+	for (i = 0; i < count; i++) {
+		fprintf(fp, "\n%s\n", sorted[i].name);
+		for (j = 0; j < merged->edge_size; j++) {
+			edge = &merged->edges[j];
+			if (edge->callee == sorted[i].name) {
+				fprintf(fp, "    <- %-40s %12llu %16llu\n", edge->caller ? edge->caller : "<spontaneous>",
+						(unsigned long long)edge->calls, (unsigned long long)edge->total);
+			}
+		}
+		for (j = 0; j < merged->edge_size; j++) {
+			edge = &merged->edges[j];
+			if (edge->callee && edge->caller == sorted[i].name) {
+				fprintf(fp, "    -> %-40s %12llu %16llu\n", edge->callee,
+						(unsigned long long)edge->calls, (unsigned long long)edge->total);
+			}
+		}
+	}
+
+	if (fp != stderr) {
+		fclose(fp);
+	}
+
+	return;
+}
@@ -0,0 +1,45 @@
+#include "stds.h"
+
+// threaded dispatch: each handler jumps straight to the next one
+int run(int *code)
+{
+	void *dispatch[4];
+	int acc = 0;
+	int pc = 0;
+
+	dispatch[0] = &&op_halt;
+	dispatch[1] = &&op_inc;
+	dispatch[2] = &&op_double;
+	dispatch[3] = &&op_print;
+
+	goto *dispatch[code[pc++]];
+op_inc:
+	acc++;
+	goto *dispatch[code[pc++]];
+op_double:
+	acc = acc * 2;
+	goto *dispatch[code[pc++]];
+op_print:
+	printf("acc = %d\n", acc);
+	goto *dispatch[code[pc++]];
+op_halt:
+	return acc;
+}
+
+int main()
+{
+	int code[8];
+
+	code[0] = 1; // inc
+	code[1] = 1; // inc
+	code[2] = 2; // double
+	code[3] = 3; // print
+	code[4] = 2; // double
+	code[5] = 1; // inc
+	code[6] = 3; // print
+	code[7] = 0; // halt
+
+	printf("result = %d\n", run(code));
+
+	return 0;
+}
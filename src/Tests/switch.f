@@ -0,0 +1,46 @@
+#include "stds.h"
+
+char *classify(int n)
+{
+	switch (n) {
+		case 0:
+			return "zero";
+		case 1: // falls through to 2
+		case 2:
+			return "small";
+		default:
+			return "large";
+	}
+
+	return "";
+}
+
+int countdown(int n)
+{
+	int steps = 0;
+
+	switch (n) {
+		case 3:
+			steps++;
+		case 2:
+			steps++;
+		case 1:
+			steps++;
+			break;
+		default:
+			steps = -1;
+	}
+
+	return steps;
+}
+
+int main()
+{
+	int i;
+
+	for (i = 0; i < 5; i++) {
+		printf("%d: %s, %d\n", i, classify(i), countdown(i));
+	}
+
+	return 0;
+}
@@ -0,0 +1,18 @@
+#include "stds.h"
+
+// expected error: Duplicate case value or default label
+int main()
+{
+	int n = 1;
+
+	switch (n) {
+		case 1:
+			printf("one\n");
+			break;
+		case 2 - 1:
+			printf("also one\n");
+			break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,26 @@
+#include "stds.h"
+
+int gcd(int a, int b)
+{
+	if (b == 0) {
+		return a;
+	}
+
+	return tail gcd(b, a % b);
+}
+
+int sum_to(int n, int acc)
+{
+	if (n == 0) {
+		return acc;
+	}
+
+	return sum_to(n - 1, acc + n); // marked tail, not required to be
+}
+
+int main()
+{
+	printf("%d, %d\n", gcd(1071, 462), sum_to(100000, 0));
+
+	return 0;
+}
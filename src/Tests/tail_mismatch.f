@@ -0,0 +1,19 @@
+#include "stds.h"
+
+// expected error: Cannot guarantee tail call: the callee and the caller have different signatures
+int step(int n)
+{
+	return n - 1;
+}
+
+int run(int n, int limit)
+{
+	return tail step(n);
+}
+
+int main()
+{
+	printf("%d\n", run(10, 0));
+
+	return 0;
+}
@@ -45,6 +45,7 @@ int main(int argc, char **argv)
 {
 	PassManager pm;
 	TargetMachine::CodeGenFileType output_file_type;
+	clock_t frontend_start;
 
 	tmp_file_paths = new vector<string>();
 	global_context = new CodeGenContext();
@@ -52,19 +53,27 @@ int main(int argc, char **argv)
 	IOSetting *settings = new IOSetting(argc, argv);
 	settings->applySetting();
 
-	main_parser->startParse(yyin);
-
 	InitializeNativeTarget();
 	InitializeAllTargets();
 	InitializeAllTargetMCs();
 	InitializeAllAsmPrinters();
 	InitializeAllAsmParsers();
 
+	frontend_start = clock();
+	main_parser->startParse(yyin); // streaming codegen may already JIT constant expressions
+
 	main_parser->generateAllDecl(*global_context);
+	if (settings->isPCHOutput()) {
+		settings->doEmitPCH(*global_context, *main_parser->getAST());
+	}
 	global_context->generateCode(*main_parser->getAST());
+	compiler_stats.frontend_time = (double)(clock() - frontend_start) / CLOCKS_PER_SEC;
 	delete main_parser;
 
+	settings->doOptimize(global_context->module);
+	global_context->checkLoopPragmas();
 	settings->doOutput(global_context->module);
+	settings->doStatsOutput();
 
 	global_context->module->dump();
 	global_context->runCode();